@@ -26,17 +26,6 @@ typedef struct {
 int main(void)
 {
   MyConf conf;
-  // Defaults
-  conf.an_integer = 10;
-  conf.a_float = 11.0f;
-  conf.a_double = 123.123;
-  conf.a_bool = true;
-  conf.a_char = 'F';
-  conf.a_str = "test";
-  conf.vec = (Vec2) {
-    .x = 1,
-    .y = 1,
-  };
   
   MicroConf config[] =
     {
@@ -50,8 +39,27 @@ int main(void)
       {MICRO_CONF_INT, &conf.vec.y, "vec.y"},
     };
   size_t num_conf = sizeof(config) / sizeof(config[0]);
+
+  // Defaults, one for each entry of config
+  MicroConfValue defaults[] =
+    {
+      {.i = 10},
+      {.f = 11.0f},
+      {.d = 123.123},
+      {.b = true},
+      {.c = 'F'},
+      {.s = "test"},
+      {.i = 1},
+      {.i = 1},
+    };
+  MicroConfDefaults plan;
+  int err = micro_conf_defaults_build(&plan, micro_conf_allocator_default(),
+                                      config, defaults, NULL, num_conf);
+  if (err != MICRO_CONF_OK) return -err;
+  micro_conf_apply_defaults(&plan);
+  micro_conf_defaults_destroy(&plan);
   
-  int err = micro_conf_parse(config, num_conf, "micro.conf");
+  err = micro_conf_parse(config, num_conf, "micro.conf");
   if (err != MICRO_CONF_OK) return -err;
 
   assert(conf.an_integer == 69);
@@ -0,0 +1,302 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+//
+// micro-conf-bench
+// ================
+//
+// Compare the key lookups and the parse of a config with many
+// entries, using the index over the MicroConf array and the
+// prepared structure-of-arrays layout. The "scan" run compares the
+// line splitter, driven by the character class table, with the
+// chained comparisons it replaced, on a long indented config. Build
+// and run it with:
+//
+//    make bench
+//
+// Each run prints its time, and on Linux its cache misses counted
+// with perf_event_open. If the kernel does not allow counting (see
+// /proc/sys/kernel/perf_event_paranoid), the misses are "n/a".
+
+#define _POSIX_C_SOURCE 200809L
+#define MICRO_CONF_IMPLEMENTATION
+#include "micro-conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  // Not declared in strict C99 mode
+  extern long syscall(long number, ...);
+#endif
+
+#define NUM_ENTRIES 10000
+#define ROUNDS      200
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Counter of the cache misses of this process, -1 if not available
+static int misses_fd = -1;
+
+static void misses_open(void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  misses_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static long long misses_read(void)
+{
+#ifdef __linux__
+  uint64_t count;
+  if (misses_fd >= 0 && read(misses_fd, &count, sizeof(count))
+      == (ssize_t)sizeof(count))
+    return (long long)count;
+#endif
+  return -1;
+}
+
+// A timed run, with its cache misses
+typedef struct {
+  double start;
+  long long misses;
+} Run;
+
+static Run run_start(void)
+{
+  Run run;
+  run.misses = misses_read();
+  run.start = now();
+  return run;
+}
+
+// Print the time and the cache misses of [run] for each of [count]
+// keys or lines
+static void run_end(Run run, const char *name, double count,
+                    const char *unit)
+{
+  double elapsed = now() - run.start;
+  long long misses = misses_read();
+  printf("%-17s %6.1f ns/%s", name, elapsed * 1e9 / count, unit);
+  if (run.misses >= 0 && misses >= 0)
+    printf("  %6.2f misses/%s\n", (double)(misses - run.misses) / count,
+           unit);
+  else
+    printf("  n/a misses/%s\n", unit);
+}
+
+// The line splitter before the character class table, with chained
+// comparisons for each byte
+static bool split_compare(const char *line, size_t len,
+                          const char **key, size_t *key_len,
+                          const char **value, size_t *value_len)
+{
+  const char *comment = (const char*)memchr(line, '#', len);
+  if (comment) len = (size_t)(comment - line);
+
+  const char *end = line + len;
+  const char *k = line;
+  while (k < end && (*k == ' ' || *k == '\n' || *k == '\t')) k++;
+  if (k == end) return false;
+
+  const char *k_end = k;
+  while (k_end < end && *k_end != ' ' && *k_end != '\t' &&
+         *k_end != '=' && *k_end != ':')
+    k_end++;
+
+  const char *v = k_end;
+  while (v < end && (*v == ' ' || *v == '\n' || *v == '\t')) v++;
+  if (v < end && (*v == '=' || *v == ':')) v++;
+  while (v < end && (*v == ' ' || *v == '\n' || *v == '\t')) v++;
+
+  while (end > v && (end[-1] == ' ' || end[-1] == '\t'))
+    end--;
+
+  *key = k;
+  *key_len = (size_t)(k_end - k);
+  *value = v;
+  *value_len = (size_t)(end - v);
+  return true;
+}
+
+// Shuffle [order] with a fixed seed, so runs are comparable
+static void shuffle(size_t *order, size_t len)
+{
+  uint32_t state = 12345;
+  for (size_t i = len - 1; i > 0; --i)
+  {
+    state = state * 1103515245u + 12345u;
+    size_t j = (state >> 8) % (i + 1);
+    size_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *only = argc > 1 ? argv[1] : NULL;
+
+  static char names[NUM_ENTRIES][32];
+  static int values[NUM_ENTRIES];
+  static MicroConf conf[NUM_ENTRIES];
+  static size_t order[NUM_ENTRIES];
+  for (size_t i = 0; i < NUM_ENTRIES; ++i)
+  {
+    snprintf(names[i], sizeof(names[i]), "section%03zu.key%05zu",
+             i % 100, i);
+    conf[i].type = MICRO_CONF_INT;
+    conf[i].value = &values[i];
+    conf[i].name = names[i];
+    order[i] = i;
+  }
+  shuffle(order, NUM_ENTRIES);
+  misses_open();
+
+  // A config setting every entry, in shuffled order
+  size_t text_cap = NUM_ENTRIES * 40;
+  char *text = malloc(text_cap);
+  if (!text) return 1;
+  size_t text_len = 0;
+  for (size_t i = 0; i < NUM_ENTRIES; ++i)
+    text_len += (size_t)snprintf(text + text_len, text_cap - text_len,
+                                 "%s = %zu\n", names[order[i]], i);
+
+  MicroConfIndex index;
+  micro_conf_index_build(&index, micro_conf_allocator_default(),
+                         conf, NUM_ENTRIES);
+  MicroConfPrepared prepared;
+  micro_conf_prepare(&prepared, micro_conf_allocator_default(),
+                     conf, NUM_ENTRIES);
+
+  size_t found = 0;
+  if (!only || strcmp(only, "index") == 0)
+  {
+    Run run = run_start();
+    for (int r = 0; r < ROUNDS; ++r)
+      for (size_t i = 0; i < NUM_ENTRIES; ++i)
+      {
+        const char *key = names[order[i]];
+        found += micro_conf_index_find(&index, conf, NUM_ENTRIES, key,
+                                       strlen(key)) != (size_t)-1;
+      }
+    run_end(run, "index lookup:", (double)ROUNDS * NUM_ENTRIES, "key");
+
+    MicroConfParser parser;
+    micro_conf_parser_init(&parser);
+    run = run_start();
+    for (int r = 0; r < ROUNDS / 10; ++r)
+      micro_conf_parser_parse_buffer(&parser, conf, NUM_ENTRIES,
+                                     text, text_len);
+    run_end(run, "index parse:", (double)(ROUNDS / 10) * NUM_ENTRIES,
+            "line");
+    micro_conf_parser_destroy(&parser);
+  }
+
+  if (!only || strcmp(only, "prepared") == 0)
+  {
+    Run run = run_start();
+    for (int r = 0; r < ROUNDS; ++r)
+      for (size_t i = 0; i < NUM_ENTRIES; ++i)
+      {
+        const char *key = names[order[i]];
+        found += micro_conf_prepared_find(&prepared, key,
+                                          strlen(key)) != (size_t)-1;
+      }
+    run_end(run, "prepared lookup:", (double)ROUNDS * NUM_ENTRIES, "key");
+
+    MicroConfParser parser;
+    micro_conf_parser_init(&parser);
+    micro_conf_parser_use_prepared(&parser, &prepared);
+    run = run_start();
+    for (int r = 0; r < ROUNDS / 10; ++r)
+      micro_conf_parser_parse_buffer(&parser, conf, NUM_ENTRIES,
+                                     text, text_len);
+    run_end(run, "prepared parse:", (double)(ROUNDS / 10) * NUM_ENTRIES,
+            "line");
+    micro_conf_parser_destroy(&parser);
+  }
+
+  if (!only || strcmp(only, "scan") == 0)
+  {
+    // Deeply indented lines with aligned values and trailing comments
+    size_t indented_cap = NUM_ENTRIES * 128;
+    char *indented = malloc(indented_cap);
+    if (!indented) return 1;
+    size_t indented_len = 0;
+    for (size_t i = 0; i < NUM_ENTRIES; ++i)
+      indented_len += (size_t)snprintf(indented + indented_len,
+                                       indented_cap - indented_len,
+                                       "%*s%s    =    %zu\t\t# entry %zu\n",
+                                       (int)(8 + i % 4 * 8), "",
+                                       names[order[i]], i, i);
+
+    const char *key, *value;
+    size_t key_len, value_len, total = 0;
+    Run run = run_start();
+    for (int r = 0; r < ROUNDS; ++r)
+      for (const char *line = indented; line < indented + indented_len;)
+      {
+        const char *nl = memchr(line, '\n', indented_len
+                                - (size_t)(line - indented));
+        if (split_compare(line, (size_t)(nl - line), &key, &key_len,
+                          &value, &value_len))
+          total += key_len + value_len;
+        line = nl + 1;
+      }
+    run_end(run, "compare split:", (double)ROUNDS * NUM_ENTRIES, "line");
+
+    run = run_start();
+    for (int r = 0; r < ROUNDS; ++r)
+      for (const char *line = indented; line < indented + indented_len;)
+      {
+        const char *nl = memchr(line, '\n', indented_len
+                                - (size_t)(line - indented));
+        if (_micro_conf_split_line(&_micro_conf_syntax_default, line,
+                                   (size_t)(nl - line), &key, &key_len,
+                                   &value, &value_len))
+          total += key_len + value_len;
+        line = nl + 1;
+      }
+    run_end(run, "table split:", (double)ROUNDS * NUM_ENTRIES, "line");
+
+    MicroConfParser parser;
+    micro_conf_parser_init(&parser);
+    run = run_start();
+    for (int r = 0; r < ROUNDS / 10; ++r)
+      micro_conf_parser_parse_buffer(&parser, conf, NUM_ENTRIES,
+                                     indented, indented_len);
+    run_end(run, "indented parse:", (double)(ROUNDS / 10) * NUM_ENTRIES,
+            "line");
+    micro_conf_parser_destroy(&parser);
+
+    found += total > 0;
+    free(indented);
+  }
+
+  micro_conf_prepared_destroy(&prepared);
+  micro_conf_index_destroy(&index);
+  free(text);
+#ifdef __linux__
+  if (misses_fd >= 0) close(misses_fd);
+#endif
+  return found > 0 ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+//
+// micro-conf-check
+// ================
+//
+// Validate config files against a schema, without compiling a
+// program per schema. Files are checked in parallel and all the
+// errors are reported, in the order of the files given.
+//
+// Usage:
+//
+//    micro-conf-check [-j threads] [-u] schema file...
+//
+//    -j threads  Number of threads, defaults to the number of CPUs
+//    -u          Report keys that are not in the schema
+//
+// Exits with 0 if all the files are valid, 1 if some are not, and
+// 2 if the schema could not be loaded.
+
+#define _POSIX_C_SOURCE 200809L
+#define MICRO_CONF_IMPLEMENTATION
+#include "micro-conf.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Errors of a file, printed after all the files are checked
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  size_t num_errors;
+} Report;
+
+typedef struct {
+  MicroConfSchema *schema;
+  char **files;
+  size_t num_files;
+  Report *reports;
+  unsigned int flags;
+  size_t next_file;  // Shared between threads
+} Check;
+
+// What the error callback needs to know about the current file
+typedef struct {
+  Report *report;
+  const char *pathname;
+  const MicroConf *conf;
+} Current;
+
+static void report_append(Report *report, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+  if (len < 0) return;
+
+  size_t needed = report->len + (size_t)len + 1;
+  if (needed > report->cap)
+  {
+    size_t cap = report->cap ? report->cap : 256;
+    while (cap < needed) cap *= 2;
+    char *data = realloc(report->data, cap);
+    if (!data) return;
+    report->data = data;
+    report->cap = cap;
+  }
+
+  va_start(args, fmt);
+  vsnprintf(report->data + report->len, (size_t)len + 1, fmt, args);
+  va_end(args);
+  report->len += (size_t)len;
+}
+
+static void on_error(void *user, const MicroConfDiagnostic *diag,
+                     const char *line)
+{
+  Current *current = user;
+  current->report->num_errors++;
+
+  if (diag->line == 0)
+  {
+    if (diag->entry != (size_t)-1)
+      report_append(current->report, "%s: %s '%s'\n", current->pathname,
+                    micro_conf_error_string(diag->error),
+                    current->conf[diag->entry].name);
+    else
+      report_append(current->report, "%s: %s\n", current->pathname,
+                    micro_conf_error_string(diag->error));
+    return;
+  }
+
+  if (diag->entry != (size_t)-1)
+  {
+    report_append(current->report, "%s:%u:%u: %s for key '%s'\n",
+                  current->pathname, diag->line, diag->column,
+                  micro_conf_error_string(diag->error),
+                  current->conf[diag->entry].name);
+    return;
+  }
+
+  // Errors of the input rather than of a key, such as a failed read
+  if (diag->column == 0)
+  {
+    report_append(current->report, "%s:%u: %s\n", current->pathname,
+                  diag->line, micro_conf_error_string(diag->error));
+    return;
+  }
+
+  // Print the key as written in the line
+  const char *key = line + diag->column - 1;
+  size_t key_len = strcspn(key, " \t=:#");
+  report_append(current->report, "%s:%u:%u: %s '%.*s'\n",
+                current->pathname, diag->line, diag->column,
+                micro_conf_error_string(diag->error), (int)key_len, key);
+}
+
+static void *check_files(void *arg)
+{
+  Check *check = arg;
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_DRY_RUN | MICRO_CONF_FLAG_KEEP_GOING
+    | check->flags;
+  parser.on_error = on_error;
+  micro_conf_parser_use_schema(&parser, check->schema);
+
+  Current current;
+  current.conf = check->schema->conf;
+  parser.on_error_user = &current;
+
+  for (;;)
+  {
+    size_t i = __atomic_fetch_add(&check->next_file, 1, __ATOMIC_RELAXED);
+    if (i >= check->num_files) break;
+
+    current.report = &check->reports[i];
+    current.pathname = check->files[i];
+    (void) micro_conf_parser_parse(&parser, check->schema->conf,
+                                   check->schema->num_conf,
+                                   check->files[i]);
+  }
+
+  micro_conf_parser_destroy(&parser);
+  return NULL;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-j threads] [-u] schema file...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned int flags = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:u")) != -1)
+  {
+    switch (opt)
+    {
+    case 'j':
+      num_threads = strtol(optarg, NULL, 10);
+      break;
+    case 'u':
+      flags |= MICRO_CONF_FLAG_UNKNOWN_KEYS;
+      break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argc - optind < 1)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  if (num_threads < 1) num_threads = 1;
+
+  const char *schema_path = argv[optind];
+  MicroConfSchema schema;
+  micro_conf_schema_init(&schema, micro_conf_allocator_default());
+  if (micro_conf_schema_load(&schema, schema_path) != MICRO_CONF_OK)
+  {
+    if (schema.diag.line > 0)
+      fprintf(stderr, "%s:%u:%u: %s\n", schema_path, schema.diag.line,
+              schema.diag.column, micro_conf_error_string(schema.diag.error));
+    else
+      fprintf(stderr, "%s: %s\n", schema_path,
+              micro_conf_error_string(schema.diag.error));
+    micro_conf_schema_destroy(&schema);
+    return 2;
+  }
+
+  Check check;
+  check.schema = &schema;
+  check.files = argv + optind + 1;
+  check.num_files = (size_t)(argc - optind - 1);
+  check.flags = flags;
+  check.next_file = 0;
+  check.reports = calloc(check.num_files + 1, sizeof(Report));
+  if (!check.reports)
+  {
+    micro_conf_schema_destroy(&schema);
+    return 2;
+  }
+
+  if ((size_t)num_threads > check.num_files)
+    num_threads = (long)check.num_files;
+  pthread_t *threads = calloc((size_t)num_threads + 1, sizeof(pthread_t));
+  long started = 0;
+  for (; threads && started < num_threads; ++started)
+    if (pthread_create(&threads[started], NULL, check_files, &check) != 0)
+      break;
+  // Check the remaining files here if threads are not available
+  if (started == 0) check_files(&check);
+  for (long i = 0; i < started; ++i)
+    pthread_join(threads[i], NULL);
+
+  size_t invalid = 0, num_errors = 0;
+  for (size_t i = 0; i < check.num_files; ++i)
+  {
+    Report *report = &check.reports[i];
+    if (report->num_errors > 0) invalid++;
+    num_errors += report->num_errors;
+    if (report->len > 0) fputs(report->data, stdout);
+    free(report->data);
+  }
+  fprintf(stderr, "%zu files checked, %zu invalid, %zu errors\n",
+          check.num_files, invalid, num_errors);
+
+  free(threads);
+  free(check.reports);
+  micro_conf_schema_destroy(&schema);
+  return invalid > 0 ? 1 : 0;
+}
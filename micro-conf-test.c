@@ -0,0 +1,1462 @@
+// SPDX-License-Identifier: MIT
+// Author:  Giovanni Santini
+// Mail:    giovanni.santini@proton.me
+// Github:  @San7o
+//
+// micro-conf-test
+// ===============
+//
+// Regression checks of the features of micro-conf.h, one function
+// per feature. Run them with `make check`, and with `make check-zlib`
+// to include the gzip support.
+
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+  #define MICRO_CONF_IO_URING
+#endif
+#define MICRO_CONF_IMPLEMENTATION
+#include "micro-conf.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEXT(str) str, sizeof(str) - 1
+
+// Allocator over malloc that counts the calls and the live bytes
+typedef struct {
+  size_t calls;
+  size_t live;
+} Counter;
+
+static void* counter_alloc(void *user, size_t size)
+{
+  Counter *counter = (Counter*)user;
+  void *ptr = malloc(size);
+  if (ptr)
+  {
+    counter->calls++;
+    counter->live += size;
+  }
+  return ptr;
+}
+
+static void* counter_realloc(void *user, void *ptr, size_t old_size,
+                             size_t new_size)
+{
+  Counter *counter = (Counter*)user;
+  void *new_ptr = realloc(ptr, new_size);
+  if (new_ptr)
+  {
+    counter->calls++;
+    counter->live += new_size - old_size;
+  }
+  return new_ptr;
+}
+
+static void counter_free(void *user, void *ptr, size_t size)
+{
+  Counter *counter = (Counter*)user;
+  if (!ptr) return;
+  counter->live -= size;
+  free(ptr);
+}
+
+static MicroConfAllocator counter_allocator(Counter *counter)
+{
+  MicroConfAllocator allocator;
+  allocator.alloc   = counter_alloc;
+  allocator.realloc = counter_realloc;
+  allocator.free    = counter_free;
+  allocator.user    = counter;
+  counter->calls = 0;
+  counter->live = 0;
+  return allocator;
+}
+
+// Write [text] to a new temporary file, whose name is written to
+// [path] of at least 32 bytes
+static void temp_file(char *path, const char *text)
+{
+  strcpy(path, "/tmp/micro-conf-XXXXXX");
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  size_t len = strlen(text);
+  assert(write(fd, text, len) == (ssize_t)len);
+  close(fd);
+}
+
+static void on_signal(int signal)
+{
+  (void) signal;
+}
+
+// Parser context: reuse across parses, chunked input and diagnostics
+static void test_parser(void)
+{
+  int x = 0, y = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_INT, &y, "y"},
+    };
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                           TEXT("x = 1\ny: 2\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(x == 1 && y == 2);
+
+  // Lines spanning chunks, and a last line without a new line
+  const char *text = "x = 30\n  y = 40";
+  err = micro_conf_parser_begin(&parser, conf, 2);
+  for (size_t i = 0; err == MICRO_CONF_OK && text[i] != '\0'; ++i)
+    err = micro_conf_parser_feed(&parser, text + i, 1);
+  if (err == MICRO_CONF_OK) err = micro_conf_parser_end(&parser);
+  assert(err == MICRO_CONF_OK);
+  assert(x == 30 && y == 40);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("x = 1\ny = oops\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT);
+  assert(parser.diag.error == MICRO_CONF_ERROR_INVALID_INT);
+  assert(parser.diag.line == 2 && parser.diag.column == 5);
+  assert(parser.diag.entry == 1);
+
+  micro_conf_parser_destroy(&parser);
+}
+
+// All the memory of a parser, strings included, comes from its
+// allocator
+static void test_allocator(void)
+{
+  int x = 0;
+  char *str = NULL;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_STR, &str, "str"},
+    };
+
+  Counter counter;
+  MicroConfAllocator allocator = counter_allocator(&counter);
+  MicroConfParser parser;
+  micro_conf_parser_init_allocator(&parser, allocator);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                           TEXT("x = 7\nstr = hello\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(x == 7 && strcmp(str, "hello") == 0);
+  assert(counter.calls > 0);
+  micro_conf_parser_destroy(&parser);
+  assert(counter.live == strlen(str) + 1);
+  counter_free(&counter, str, strlen(str) + 1);
+  assert(counter.live == 0);
+}
+
+// The arena serves the index, the line buffer and the strings from a
+// fixed buffer
+static void test_arena(void)
+{
+  static unsigned char memory[4096];
+  MicroConfArena arena;
+  micro_conf_arena_init(&arena, memory, sizeof(memory));
+
+  char *str = NULL;
+  MicroConf conf[] = {{MICRO_CONF_STR, &str, "str"}};
+  MicroConfParser parser;
+  micro_conf_parser_init_allocator(&parser,
+                                   micro_conf_arena_allocator(&arena));
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                           TEXT("str = arena\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(strcmp(str, "arena") == 0);
+  assert((unsigned char*)str >= memory &&
+         (unsigned char*)str < memory + sizeof(memory));
+  micro_conf_parser_destroy(&parser);
+
+  // No room for the line buffer
+  micro_conf_arena_init(&arena, memory, 8);
+  int x = 0;
+  MicroConf small[] = {{MICRO_CONF_INT, &x, "x"}};
+  micro_conf_parser_init_allocator(&parser,
+                                   micro_conf_arena_allocator(&arena));
+  err = micro_conf_parser_parse_buffer(&parser, small, 1, TEXT("x = 3\n"));
+  assert(err == MICRO_CONF_ERROR_OUT_OF_MEMORY);
+  micro_conf_parser_destroy(&parser);
+}
+
+// Errors seen by an on_error callback
+typedef struct {
+  int errors[8];
+  unsigned int lines[8];
+  unsigned int columns[8];
+  char at[8];  // The byte of the line at the column
+  size_t count;
+} Errors;
+
+static void on_error(void *user, const MicroConfDiagnostic *diag,
+                     const char *line)
+{
+  Errors *errors = (Errors*)user;
+  // The column is 1-based inside [line], or 0 for errors that are not
+  // about a key or a value
+  assert(diag->column <= strlen(line) + 1);
+  if (errors->count < 8)
+  {
+    errors->errors[errors->count] = diag->error;
+    errors->lines[errors->count] = diag->line;
+    errors->columns[errors->count] = diag->column;
+    errors->at[errors->count] = diag->column > 0 ? line[diag->column - 1] : 0;
+  }
+  errors->count++;
+}
+
+// Loader that gives one line, then fails
+static int failing_read(void *user, char *buffer, size_t size,
+                        size_t *read)
+{
+  int *calls = (int*)user;
+  *read = 0;
+  if ((*calls)++ > 0) return MICRO_CONF_ERROR_READING_FILE;
+  const char *text = "x = 1\nx =";
+  assert(size >= strlen(text));
+  memcpy(buffer, text, strlen(text));
+  *read = strlen(text);
+  return MICRO_CONF_OK;
+}
+
+// A dry run reports all the errors and writes nothing; errors of the
+// input itself have no column
+static void test_dry_run(void)
+{
+  int x = 3;
+  bool b = false;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_BOOL, &b, "b"},
+    };
+
+  Errors errors;
+  memset(&errors, 0, sizeof(errors));
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_DRY_RUN | MICRO_CONF_FLAG_KEEP_GOING
+    | MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+    TEXT("x = 10\nb = maybe\nnope = 1\nx = 2x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_BOOL);
+  assert(x == 3 && b == false);
+  assert(errors.count == 3);
+  assert(errors.errors[1] == MICRO_CONF_ERROR_UNKNOWN_KEY);
+  assert(errors.lines[1] == 3 && errors.columns[1] == 1);
+  assert(errors.errors[2] == MICRO_CONF_ERROR_INVALID_INT);
+
+  memset(&errors, 0, sizeof(errors));
+  int calls = 0;
+  MicroConfLoader loader = {failing_read, &calls};
+  err = micro_conf_parser_parse_loader(&parser, conf, 2, &loader);
+  assert(err == MICRO_CONF_ERROR_READING_FILE);
+  assert(errors.count == 1);
+  assert(errors.lines[0] > 0 && errors.columns[0] == 0);
+  micro_conf_parser_destroy(&parser);
+}
+
+// Schemas load defaults and ranges, with comments outside of quotes
+static void test_schema(void)
+{
+  MicroConfSchema schema;
+  micro_conf_schema_init(&schema, micro_conf_allocator_default());
+  int err = micro_conf_schema_parse(&schema, TEXT(
+    "# a schema\n"
+    "count = int default=10 min=0 max=100  # a comment\n"
+    "name  = str default=\"a # b\" max=8\n"
+    "ratio = double required\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(schema.num_conf == 3);
+  assert(strcmp(schema.conf[0].name, "count") == 0);
+  assert(schema.has_default[0] && schema.defaults[0].i == 10);
+  assert(schema.ranges[0].max == 100);
+  assert(strcmp(schema.defaults[1].s, "a # b") == 0);
+  assert(schema.ranges[1].flags == MICRO_CONF_RANGE_MAX);
+  assert(!schema.has_default[2]);
+  assert(schema.conf[2].type
+         == MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_DOUBLE));
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_DRY_RUN;
+  micro_conf_parser_use_schema(&parser, &schema);
+  err = micro_conf_parser_parse_buffer(&parser, schema.conf,
+                                       schema.num_conf,
+                                       TEXT("ratio = 1\ncount = 101\n"));
+  assert(err == MICRO_CONF_ERROR_OUT_OF_RANGE);
+  assert(parser.diag.line == 2 && parser.diag.entry == 0);
+  micro_conf_parser_destroy(&parser);
+
+  // Text after a closing quote, a missing quote, a default out of
+  // range
+  err = micro_conf_schema_parse(&schema,
+                                TEXT("name = str default=\"a\"b\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  assert(schema.diag.line == 1 && schema.diag.column == 23);
+  err = micro_conf_schema_parse(&schema, TEXT("name = str default=\"a\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  err = micro_conf_schema_parse(&schema,
+                                TEXT("\nn = int default=5 max=4\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  assert(schema.diag.line == 2 && schema.diag.entry == 0);
+  micro_conf_schema_destroy(&schema);
+}
+
+// Defaults of adjacent variables are written by a single copy
+static void test_defaults(void)
+{
+  struct {
+    int a;
+    int b;
+    double c;
+  } vars = {0, 0, 0.0};
+  int apart = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &vars.b, "b"},
+      {MICRO_CONF_INT, &apart, "apart"},
+      {MICRO_CONF_INT, &vars.a, "a"},
+      {MICRO_CONF_DOUBLE, &vars.c, "c"},
+    };
+  MicroConfValue defaults[] = {{.i = 2}, {.i = 9}, {.i = 1}, {.d = 0.5}};
+  bool has_default[] = {true, false, true, true};
+
+  MicroConfDefaults plan;
+  int err = micro_conf_defaults_build(&plan, micro_conf_allocator_default(),
+                                      conf, defaults, has_default, 4);
+  assert(err == MICRO_CONF_OK);
+  assert(plan.num_copies <= 2);  // a and b share a copy
+  micro_conf_apply_defaults(&plan);
+  assert(vars.a == 1 && vars.b == 2 && vars.c == 0.5 && apart == 0);
+  micro_conf_defaults_destroy(&plan);
+}
+
+// Required keys are reported once: as missing, or for their value
+static void test_required(void)
+{
+  enum { NUM_CONF = 300 };  // More than fit in the inline bitsets
+  static char names[NUM_CONF][24];  // "k" and any number
+  static int vars[NUM_CONF];
+  static MicroConf conf[NUM_CONF];
+  for (size_t i = 0; i < NUM_CONF; ++i)
+  {
+    snprintf(names[i], sizeof(names[i]), "k%zu", i);
+    conf[i].type = MICRO_CONF_INT;
+    conf[i].value = &vars[i];
+    conf[i].name = names[i];
+  }
+  conf[1].type = MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT);
+  conf[2].type = MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT);
+  conf[299].type = MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT);
+
+  Errors errors;
+  memset(&errors, 0, sizeof(errors));
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_KEEP_GOING;
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, NUM_CONF,
+                                           TEXT("k0 = 1\nk2 = bad\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT);
+  assert(errors.count == 3);
+  assert(errors.errors[0] == MICRO_CONF_ERROR_INVALID_INT);
+  assert(errors.errors[1] == MICRO_CONF_ERROR_MISSING_KEY);
+  assert(errors.errors[2] == MICRO_CONF_ERROR_MISSING_KEY);
+
+  size_t missing[4];
+  assert(micro_conf_parser_missing(&parser, missing, 4) == 2);
+  assert(missing[0] == 1 && missing[1] == 299);
+  assert(micro_conf_parser_from_file(&parser, 0));
+  assert(!micro_conf_parser_from_file(&parser, 2));
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, NUM_CONF,
+                                       TEXT("k1 = 1\nk2 = 2\nk299 = 3\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_parser_missing(&parser, missing, 4) == 0);
+  micro_conf_parser_destroy(&parser);
+}
+
+// Provenance records the source, line and offset of the last value
+// of each entry, across layered parses
+static void test_provenance(void)
+{
+  int x = 0, y = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_INT, &y, "y"},
+    };
+  MicroConfProvenance provenance[2];
+  memset(provenance, 0, sizeof(provenance));
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.provenance = provenance;
+  parser.source_id = 0;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                           TEXT("x = 1\ny = 2\n"));
+  assert(err == MICRO_CONF_OK);
+  parser.source_id = 1;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("# user\n  y = 20\n"));
+  assert(err == MICRO_CONF_OK);
+
+  const MicroConfProvenance *p = micro_conf_parser_provenance(&parser, 0);
+  assert(p && p->source == 0 && p->line == 1 && p->offset == 4);
+  p = micro_conf_parser_provenance(&parser, 1);
+  assert(p && p->source == 1 && p->line == 2 && p->offset == 13);
+  assert(x == 1 && y == 20);
+  micro_conf_parser_destroy(&parser);
+}
+
+// Booleans and keywords are matched ignoring case
+static void test_keywords(void)
+{
+  bool b[5] = {0};
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_BOOL, &b[0], "a"},
+      {MICRO_CONF_BOOL, &b[1], "b"},
+      {MICRO_CONF_BOOL, &b[2], "c"},
+      {MICRO_CONF_BOOL, &b[3], "d"},
+      {MICRO_CONF_BOOL, &b[4], "e"},
+    };
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 5,
+                                           TEXT("a = true\nb = TRUE\n"
+                                                "c = Yes\nd = on\ne = 1\n"));
+  assert(err == MICRO_CONF_OK && b[0] && b[1] && b[2] && b[3] && b[4]);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 5,
+                                       TEXT("a = false\nb = No\nc = OFF\n"
+                                            "d = 0\ne = fAlSe\n"));
+  assert(err == MICRO_CONF_OK && !b[0] && !b[1] && !b[2] && !b[3] && !b[4]);
+
+  Errors errors = {0};
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  parser.flags = MICRO_CONF_FLAG_KEEP_GOING;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 5,
+                                       TEXT("a = tru\nb = truee\nc = yes!\n"
+                                            "d = onn\ne = 2\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_BOOL && errors.count == 5);
+  assert(!b[0] && !b[1] && !b[2] && !b[3] && !b[4]);
+  micro_conf_parser_destroy(&parser);
+
+  const char *levels[] = {"debug", "info", "warning", "error"};
+  assert(micro_conf_keyword_find(levels, 4, TEXT("WARNING")) == 2);
+  assert(micro_conf_keyword_find(levels, 4, TEXT("Info")) == 1);
+  assert(micro_conf_keyword_find(levels, 4, TEXT("warn")) == (size_t)-1);
+  assert(micro_conf_keyword_find(levels, 4, TEXT("errors")) == (size_t)-1);
+}
+
+// Sorted input is matched in one walk, and keys out of order still
+// match through the index
+static void test_sorted(void)
+{
+  int a = 0, b = 0, c = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &c, "c"},
+      {MICRO_CONF_INT, &a, "a"},
+      {MICRO_CONF_INT, &b, "b"},
+    };
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                           TEXT("a = 1\n"));
+  assert(err == MICRO_CONF_OK && a == 1);
+
+  // Sorting changes the entries, so the parser starts over
+  micro_conf_sort(conf, 3);
+  assert(strcmp(conf[0].name, "a") == 0 && strcmp(conf[2].name, "c") == 0);
+  micro_conf_parser_destroy(&parser);
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_SORTED | MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                       TEXT("a = 10\nb = 20\nc = 30\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(a == 10 && b == 20 && c == 30);
+  assert(parser.in_order);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                       TEXT("b = 2\na = 1\nc = 3\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(a == 1 && b == 2 && c == 3);
+  assert(!parser.in_order);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                       TEXT("a = 1\nab = 2\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY);
+  micro_conf_parser_destroy(&parser);
+}
+
+// A prepared array finds the same entries as the index, and can be
+// shared by parsers
+static void test_prepared(void)
+{
+  int a = 0, b = 0;
+  char *s = NULL;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &a, "section.a"},
+      {MICRO_CONF_INT, &b, "section.b"},
+      {MICRO_CONF_STR, &s, "s"},
+    };
+  MicroConfPrepared prepared;
+  int err = micro_conf_prepare(&prepared, micro_conf_allocator_default(),
+                               conf, 3);
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_prepared_find(&prepared, TEXT("section.b")) == 1);
+  assert(micro_conf_prepared_find(&prepared, TEXT("section.")) == (size_t)-1);
+  assert(micro_conf_prepared_find(&prepared, TEXT("s")) == 2);
+
+  MicroConfParser first, second;
+  micro_conf_parser_init(&first);
+  micro_conf_parser_init(&second);
+  micro_conf_parser_use_prepared(&first, &prepared);
+  micro_conf_parser_use_prepared(&second, &prepared);
+  err = micro_conf_parser_parse_buffer(&first, conf, 3,
+                                       TEXT("section.a = 1\ns = one\n"));
+  assert(err == MICRO_CONF_OK && a == 1 && strcmp(s, "one") == 0);
+  free(s);
+  err = micro_conf_parser_parse_buffer(&second, conf, 3,
+                                       TEXT("section.b = 2\n"));
+  assert(err == MICRO_CONF_OK && b == 2);
+  micro_conf_parser_destroy(&first);
+  micro_conf_parser_destroy(&second);
+  micro_conf_prepared_destroy(&prepared);
+}
+
+// Lazy values convert on demand and fall back to their default
+// when the text of the last parse is invalid
+static void test_lazy(void)
+{
+  MicroConfLazy lazy = {0};
+  lazy.value.i = 42;
+  MicroConf conf[] = {{MICRO_CONF_LAZY_TYPE(MICRO_CONF_INT), &lazy, "n"}};
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  MicroConfValue value;
+  assert(micro_conf_lazy_get(&lazy, &value) == MICRO_CONF_OK);
+  assert(value.i == 42);
+
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                           TEXT("n = 17\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_lazy_get(&lazy, &value) == MICRO_CONF_OK);
+  assert(value.i == 17 && lazy.value.i == 42);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("n = abc\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_lazy_get(&lazy, &value) == MICRO_CONF_ERROR_INVALID_INT);
+  assert(value.i == 42);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("n = 9\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_lazy_get(&lazy, &value) == MICRO_CONF_OK);
+  assert(value.i == 9);
+  micro_conf_parser_destroy(&parser);
+  micro_conf_lazy_destroy(&lazy);
+}
+
+typedef struct {
+  char match[16];
+  long long sum;
+  size_t calls;
+} Weights;
+
+static int add_weight(void *user, const char *key, size_t key_len,
+                      const char *match, size_t match_len,
+                      const MicroConfValue *value, size_t value_len)
+{
+  (void) key;
+  (void) key_len;
+  (void) value_len;
+  Weights *weights = (Weights*)user;
+  if (match_len >= sizeof(weights->match))
+    return MICRO_CONF_ERROR_OUT_OF_RANGE;
+  memcpy(weights->match, match, match_len);
+  weights->match[match_len] = '\0';
+  weights->sum += value->i;
+  weights->calls++;
+  return MICRO_CONF_OK;
+}
+
+// The first pattern in declaration order wins, and keys with an
+// entry of their own never reach the patterns
+static void test_patterns(void)
+{
+  Weights weights = {{0}, 0, 0}, other = {{0}, 0, 0};
+  MicroConfPattern patterns[] =
+    {
+      {"backend.*.weight", MICRO_CONF_INT, add_weight, &weights},
+      {"backend.*", MICRO_CONF_INT, add_weight, &other},
+    };
+  MicroConfPatternSet set;
+  int err = micro_conf_patterns_build(&set, micro_conf_allocator_default(),
+                                      patterns, 2);
+  assert(err == MICRO_CONF_OK);
+  size_t offset, len;
+  assert(micro_conf_patterns_match(&set, TEXT("backend.a.weight"),
+                                   &offset, &len) == 0);
+  assert(offset == 8 && len == 1);
+  assert(micro_conf_patterns_match(&set, TEXT("backend.a.port"),
+                                   &offset, &len) == 1);
+  assert(micro_conf_patterns_match(&set, TEXT("backen"), NULL, NULL)
+         == (size_t)-1);
+
+  int fixed = 0;
+  MicroConf conf[] = {{MICRO_CONF_INT, &fixed, "backend.fixed"}};
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  parser.patterns = &set;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                       TEXT("backend.a.weight = 3\n"
+                                            "backend.bb.weight = 4\n"
+                                            "backend.fixed = 5\n"
+                                            "backend.c.port = 80\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(weights.calls == 2 && weights.sum == 7);
+  assert(strcmp(weights.match, "bb") == 0);
+  assert(other.calls == 1 && other.sum == 80);
+  assert(strcmp(other.match, "c.port") == 0);
+  assert(fixed == 5);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                       TEXT("backend.a.weight = x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT);
+  assert(parser.diag.column == 20);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                       TEXT("frontend = 1\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY);
+  micro_conf_parser_destroy(&parser);
+  micro_conf_patterns_destroy(&set);
+
+  MicroConfPattern invalid[] = {{"a.*.*", MICRO_CONF_INT, NULL, NULL}};
+  err = micro_conf_patterns_build(&set, micro_conf_allocator_default(),
+                                  invalid, 1);
+  assert(err == MICRO_CONF_ERROR_INVALID_SCHEMA);
+}
+
+// A map collects the keys under its name, grows past its first
+// table and releases every key and string with its allocator
+static void test_map(void)
+{
+  int global = 0;
+  MicroConfMap hosts = {0};
+  hosts.type = MICRO_CONF_STR;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_MAP, &hosts, "hosts"},
+      {MICRO_CONF_INT, &global, "hosts.global"},
+    };
+
+  char text[1024];
+  size_t len = 0;
+  for (int i = 0; i < 40; ++i)
+    len += (size_t)snprintf(text + len, sizeof(text) - len,
+                            "hosts.h%d = 10.0.0.%d\n", i, i);
+  len += (size_t)snprintf(text + len, sizeof(text) - len,
+                          "hosts.h3 = replaced\nhosts.global = 1\n");
+  assert(len < sizeof(text));
+
+  Counter counter;
+  MicroConfParser parser;
+  micro_conf_parser_init_allocator(&parser, counter_allocator(&counter));
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2, text, len);
+  assert(err == MICRO_CONF_OK);
+  assert(hosts.count == 40 && hosts.capacity >= 64);
+  assert(global == 1);
+  assert(micro_conf_map_get(&hosts, TEXT("global")) == NULL);
+  const MicroConfValue *value = micro_conf_map_get(&hosts, TEXT("h39"));
+  assert(value && strcmp(value->s, "10.0.0.39") == 0);
+  value = micro_conf_map_get(&hosts, TEXT("h3"));
+  assert(value && strcmp(value->s, "replaced") == 0);
+  assert(micro_conf_map_get(&hosts, TEXT("h40")) == NULL);
+
+  micro_conf_parser_destroy(&parser);
+  micro_conf_map_destroy(&hosts);
+  assert(hosts.count == 0);
+  assert(counter.live == 0);
+}
+
+// A rollback writes back an older snapshot, with strings owned by
+// the history, and the ring forgets snapshots past its depth
+static void test_history(void)
+{
+  int x = 1;
+  const char *s = "one";
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_STR, &s, "s"},
+    };
+  Counter counter;
+  MicroConfHistory history;
+  int err = micro_conf_history_init(&history, counter_allocator(&counter),
+                                    conf, 2, 2);
+  assert(err == MICRO_CONF_OK);
+  assert(micro_conf_rollback(&history, 0) == MICRO_CONF_ERROR_OUT_OF_RANGE);
+
+  assert(micro_conf_history_push(&history) == MICRO_CONF_OK);
+  x = 2;
+  assert(micro_conf_history_push(&history) == MICRO_CONF_OK);
+  assert(history.ring[history.head].num_changed == 1);
+  x = 3;
+  s = "three";
+  assert(micro_conf_history_push(&history) == MICRO_CONF_OK);
+  assert(micro_conf_rollback(&history, 2) == MICRO_CONF_ERROR_OUT_OF_RANGE);
+
+  assert(micro_conf_rollback(&history, 1) == MICRO_CONF_OK);
+  assert(x == 2 && strcmp(s, "one") == 0);
+  // The strings written by a rollback are copies owned by the program,
+  // which frees them before or after the history
+  char *copy = (char*)s;
+  x = 9;
+  assert(micro_conf_rollback(&history, 0) == MICRO_CONF_OK);
+  assert(x == 2 && strcmp(s, "one") == 0 && s != copy);
+  counter_free(&counter, copy, strlen(copy) + 1);
+
+  micro_conf_history_destroy(&history);
+  assert(strcmp(s, "one") == 0);
+  counter_free(&counter, (char*)s, strlen(s) + 1);
+  assert(counter.live == 0);
+}
+
+// Whether [digest] holds the bytes written in hexadecimal in [hex]
+static bool digest_is(const unsigned char *digest, const char *hex)
+{
+  char text[2 * MICRO_CONF_DIGEST_SIZE + 1];
+  for (size_t i = 0; i < MICRO_CONF_DIGEST_SIZE; ++i)
+    snprintf(text + 2 * i, 3, "%02x", digest[i]);
+  return strcmp(text, hex) == 0;
+}
+
+// Accepts the first value, then fails with
+// MICRO_CONF_ERROR_OUT_OF_RANGE
+static int accept_once(void *user, size_t entry, const MicroConfValue *value,
+                       size_t value_len)
+{
+  (void) entry;
+  (void) value;
+  (void) value_len;
+  size_t *calls = (size_t*)user;
+  return (*calls)++ == 0 ? MICRO_CONF_OK : MICRO_CONF_ERROR_OUT_OF_RANGE;
+}
+
+// SHA-256 vectors of FIPS 180-2, HMAC-SHA-256 vectors of RFC 4231,
+// and parses checked against a digest
+static void test_digest(void)
+{
+  unsigned char out[MICRO_CONF_DIGEST_SIZE];
+  MicroConfDigest digest;
+  micro_conf_digest_init(&digest);
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "e3b0c44298fc1c149afbf4c8996fb924"
+                        "27ae41e4649b934ca495991b7852b855"));
+  micro_conf_digest_init(&digest);
+  micro_conf_digest_update(&digest, TEXT("abc"));
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "ba7816bf8f01cfea414140de5dae2223"
+                        "b00361a396177a9cb410ff61f20015ad"));
+  // Two blocks, fed in pieces that do not align with them
+  const char two_blocks[] =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  micro_conf_digest_init(&digest);
+  micro_conf_digest_update(&digest, two_blocks, 5);
+  micro_conf_digest_update(&digest, two_blocks + 5, sizeof(two_blocks) - 6);
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "248d6a61d20638b8e5c026930c3e6039"
+                        "a33ce45964ff2167f6ecedd419db06c1"));
+
+  unsigned char key[131];
+  memset(key, 0x0b, 20);
+  micro_conf_digest_init_hmac(&digest, key, 20);
+  micro_conf_digest_update(&digest, TEXT("Hi There"));
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "b0344c61d8db38535ca8afceaf0bf12b"
+                        "881dc200c9833da726e9376c2e32cff7"));
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  micro_conf_digest_update(&digest, TEXT("what do ya want for nothing?"));
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "5bdcc146bf60754e6a042426089575c7"
+                        "5a003f089d2739839dec58b964ec3843"));
+  // A key longer than a block is hashed first
+  memset(key, 0xaa, sizeof(key));
+  micro_conf_digest_init_hmac(&digest, key, sizeof(key));
+  micro_conf_digest_update(&digest, TEXT("Test Using Larger Than Block-Size"
+                                         " Key - Hash Key First"));
+  micro_conf_digest_final(&digest, out);
+  assert(digest_is(out, "60e431591ee0b67f0d8a26aacbf5b77f"
+                        "8e0bc6213728c5140546040f0ee37f54"));
+
+  int x = 0;
+  MicroConf conf[] = {{MICRO_CONF_INT, &x, "x"}};
+  unsigned char expected[MICRO_CONF_DIGEST_SIZE];
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  micro_conf_digest_update(&digest, TEXT("x = 5\n"));
+  micro_conf_digest_final(&digest, expected);
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.digest = &digest;
+  parser.expected_digest = expected;
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 1,
+                                           TEXT("x = 5\n"));
+  assert(err == MICRO_CONF_OK && x == 5);
+
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("x = 6\n"));
+  assert(err == MICRO_CONF_ERROR_DIGEST_MISMATCH && x == 5);
+
+  parser.flags = MICRO_CONF_FLAG_DRY_RUN;
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("x = 6\n"));
+  assert(err == MICRO_CONF_ERROR_DIGEST_MISMATCH && x == 5);
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("x = 5\n"));
+  assert(err == MICRO_CONF_OK);
+
+  // A verified input is not replayed if a required key is missing
+  int y = 0;
+  MicroConf required[] =
+    {
+      {MICRO_CONF_INT, &x, "x"},
+      {MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT), &y, "y"},
+    };
+  parser.flags = 0;
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  micro_conf_digest_update(&digest, TEXT("x = 7\n"));
+  micro_conf_digest_final(&digest, expected);
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, required, 2,
+                                       TEXT("x = 7\n"));
+  assert(err == MICRO_CONF_ERROR_MISSING_KEY && x == 5);
+
+  // The replay counts no hit in the adaptive order, and its errors
+  // come with the text of their line
+  micro_conf_parser_destroy(&parser);
+  micro_conf_parser_init(&parser);
+  parser.digest = &digest;
+  parser.expected_digest = expected;
+  parser.flags = MICRO_CONF_FLAG_ADAPTIVE;
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("x = 7\n"));
+  assert(err == MICRO_CONF_OK && x == 7);
+  assert(parser.hits[0] == 1);
+
+  Errors errors = {0};
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  size_t calls = 0;
+  parser.validate = accept_once;
+  parser.validate_user = &calls;
+  micro_conf_digest_init_hmac(&digest, "Jefe", 4);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 1, TEXT("x = 7\n"));
+  assert(err == MICRO_CONF_ERROR_OUT_OF_RANGE && calls == 2);
+  assert(errors.count == 1 && errors.lines[0] == 1 && errors.at[0] == '7');
+  micro_conf_parser_destroy(&parser);
+}
+
+#ifdef MICRO_CONF_ZLIB
+// Compress [len] bytes of [text] as a gzip member in [out] of [cap]
+// bytes, returning its size
+static size_t gzip_text(const char *text, size_t len, unsigned char *out,
+                        size_t cap)
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  assert(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                      8, Z_DEFAULT_STRATEGY) == Z_OK);
+  stream.next_in = (Bytef*)text;
+  stream.avail_in = (uInt)len;
+  stream.next_out = out;
+  stream.avail_out = (uInt)cap;
+  assert(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  size_t size = cap - stream.avail_out;
+  deflateEnd(&stream);
+  return size;
+}
+#endif
+
+// Parse [conf] from a FIFO a child writes [len] bytes of [data] to
+static int parse_fifo(MicroConfParser *parser, MicroConf *conf,
+                      size_t num_conf, const void *data, size_t len)
+{
+  char fifo[32];
+  temp_file(fifo, "");
+  unlink(fifo);
+  assert(mkfifo(fifo, 0600) == 0);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0)
+  {
+    int fd = open(fifo, O_WRONLY);
+    if (fd >= 0 && write(fd, data, len) == (ssize_t)len) close(fd);
+    _exit(0);
+  }
+  int err = micro_conf_parser_parse(parser, conf, num_conf, fifo);
+  waitpid(child, NULL, 0);
+  unlink(fifo);
+  return err;
+}
+
+// Files are read without seeking back, so pipes work, and gzip files
+// are decompressed with the allocator of the parser
+static void test_files(void)
+{
+  int a = 0;
+  MicroConf conf[] = {{MICRO_CONF_INT, &a, "a"}};
+  Counter counter;
+  MicroConfParser parser;
+  micro_conf_parser_init_allocator(&parser, counter_allocator(&counter));
+  int err = parse_fifo(&parser, conf, 1, TEXT("a = 3\n"));
+  assert(err == MICRO_CONF_OK && a == 3);
+
+  // Shorter than the gzip magic
+  char path[32];
+  temp_file(path, "\n");
+  err = micro_conf_parser_parse(&parser, conf, 1, path);
+  unlink(path);
+  assert(err == MICRO_CONF_OK);
+
+#ifdef MICRO_CONF_ZLIB
+  unsigned char gzipped[256];
+  size_t size = gzip_text(TEXT("a = 4\n"), gzipped, sizeof(gzipped));
+  size_t calls = counter.calls;
+  err = parse_fifo(&parser, conf, 1, gzipped, size);
+  assert(err == MICRO_CONF_OK && a == 4);
+  // The gzip state and the state of zlib
+  assert(counter.calls >= calls + 2);
+
+  size = gzip_text(TEXT("a = 5"), gzipped, sizeof(gzipped));
+  temp_file(path, "");
+  FILE *file = fopen(path, "wb");
+  assert(file && fwrite(gzipped, 1, size, file) == size);
+  fclose(file);
+  err = micro_conf_parser_parse(&parser, conf, 1, path);
+  unlink(path);
+  assert(err == MICRO_CONF_OK && a == 5);
+#endif
+  micro_conf_parser_destroy(&parser);
+  assert(counter.live == 0);
+}
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+// Readers keep the values they got until something new is
+// published, and the last one to drop them frees them
+static void test_publisher(void)
+{
+  int threads = 4;
+  char name[8] = "first";
+  char *name_ptr = name;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &threads, "threads"},
+      {MICRO_CONF_STR, &name_ptr, "name"},
+    };
+  Counter counter;
+  MicroConfPublisher publisher;
+  int err = micro_conf_publisher_init(&publisher, counter_allocator(&counter),
+                                      conf, 2);
+  assert(err == MICRO_CONF_OK);
+  MicroConfReader reader;
+  micro_conf_reader_init(&reader, &publisher);
+  assert(micro_conf_reader_get(&reader) == NULL);
+
+  assert(micro_conf_publish(&publisher) == MICRO_CONF_OK);
+  const MicroConfValue *values = micro_conf_reader_get(&reader);
+  assert(values && values[0].i == 4 && strcmp(values[1].s, "first") == 0);
+  assert(values[1].s != name);
+  assert(micro_conf_reader_get(&reader) == values);
+
+  threads = 8;
+  strcpy(name, "second");
+  assert(micro_conf_publish(&publisher) == MICRO_CONF_OK);
+  // Still held by the reader
+  assert(values[0].i == 4 && strcmp(values[1].s, "first") == 0);
+  values = micro_conf_reader_get(&reader);
+  assert(values[0].i == 8 && strcmp(values[1].s, "second") == 0);
+
+  micro_conf_reader_release(&reader);
+  assert(counter.live > 0);
+  micro_conf_publisher_destroy(&publisher);
+  assert(counter.live == 0);
+}
+
+// Seqlock parses convert the values as they read the lines, and
+// write them all in one write section at the end
+static void test_seqlock(void)
+{
+  int a = 0;
+  double b = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &a, "a"},
+      {MICRO_CONF_DOUBLE, &b, "b"},
+    };
+  MicroConfSeqlock seqlock = {0};
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.seqlock = &seqlock;
+  parser.flags = MICRO_CONF_FLAG_SORTED;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                           TEXT("a = 1\nb = 2.5\n"));
+  assert(err == MICRO_CONF_OK && a == 1 && b == 2.5);
+  assert(seqlock.sequence == 2);
+  assert(parser.in_order && !parser.index.slots);
+
+  // Nothing is written if the parse fails
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("a = 3\nb = x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_DOUBLE && a == 1);
+  assert(seqlock.sequence == 2);
+
+  // Nor if a required key is missing, or if the error of a line was
+  // skipped
+  MicroConf required[] =
+    {
+      {MICRO_CONF_INT, &a, "a"},
+      {MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_DOUBLE), &b, "b"},
+    };
+  err = micro_conf_parser_parse_buffer(&parser, required, 2,
+                                       TEXT("a = 42\n"));
+  assert(err == MICRO_CONF_ERROR_MISSING_KEY && a == 1);
+  assert(seqlock.sequence == 2);
+  parser.flags |= MICRO_CONF_FLAG_KEEP_GOING;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("a = 42\nb = x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_DOUBLE && a == 1 && b == 2.5);
+  assert(seqlock.sequence == 2);
+  parser.flags = MICRO_CONF_FLAG_SORTED;
+
+  // With a digest, the verified lines are replayed once
+  unsigned char expected[MICRO_CONF_DIGEST_SIZE];
+  MicroConfDigest digest;
+  micro_conf_digest_init(&digest);
+  micro_conf_digest_update(&digest, TEXT("a = 4\nb = 5\n"));
+  micro_conf_digest_final(&digest, expected);
+  micro_conf_digest_init(&digest);
+  parser.digest = &digest;
+  parser.expected_digest = expected;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("a = 4\nb = 5\n"));
+  assert(err == MICRO_CONF_OK && a == 4 && b == 5);
+  assert(seqlock.sequence == 4);
+  assert(parser.in_order && !parser.index.slots);
+  micro_conf_parser_destroy(&parser);
+
+  micro_conf_parser_init(&parser);
+  parser.seqlock = &seqlock;
+  parser.flags = MICRO_CONF_FLAG_ADAPTIVE;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2, TEXT("b = 6\n"));
+  assert(err == MICRO_CONF_OK && b == 6);
+  assert(parser.order[0] == 1 && parser.hits[0] == 1);
+
+  char *str = NULL;
+  MicroConf strings[] = {{MICRO_CONF_STR, &str, "str"}};
+  err = micro_conf_parser_parse_buffer(&parser, strings, 1,
+                                       TEXT("str = x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_SCHEMA && !str);
+  micro_conf_parser_destroy(&parser);
+}
+#endif
+
+// UTF-8 is validated in keys and strings with MICRO_CONF_FLAG_UTF8,
+// and BOMs and CRLF line endings are not part of the keys and values
+static void test_utf8(void)
+{
+  int n = 0;
+  char *name = NULL;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &n, "n"},
+      {MICRO_CONF_STR, &name, "name"},
+    };
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                           TEXT("\xEF\xBB\xBFn = 5\r\n"
+                                                "name = x\r\n"));
+  assert(err == MICRO_CONF_OK && n == 5 && strcmp(name, "x") == 0);
+  free(name);
+
+  // Columns point inside the line given to on_error, without the BOM
+  Errors errors;
+  memset(&errors, 0, sizeof(errors));
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("\xEF\xBB\xBFn = x\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT);
+  assert(errors.count == 1 && errors.columns[0] == 5 && errors.at[0] == 'x');
+
+  parser.flags = MICRO_CONF_FLAG_UTF8 | MICRO_CONF_FLAG_KEEP_GOING;
+  memset(&errors, 0, sizeof(errors));
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("name = h\xC3\xA9llo "
+                                            "\xF0\x9F\x98\x80\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(strcmp(name, "h\xC3\xA9llo \xF0\x9F\x98\x80") == 0);
+  free(name);
+  name = NULL;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("name = overlong \xC0\xAF\n"
+                                            "name = surrogate \xED\xA0\x80\n"
+                                            "name = cut \xE2\x82\n"
+                                            "name = long ascii before it\xFF\n"
+                                            "n\xFF = 1\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_UTF8 && !name);
+  assert(errors.count == 5);
+  for (size_t e = 0; e < 4; ++e)
+    assert(errors.errors[e] == MICRO_CONF_ERROR_INVALID_UTF8 &&
+           errors.columns[e] == 8);
+  assert(errors.columns[4] == 1);
+
+  // Without the flag, the bytes are kept as they are
+  parser.flags = 0;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 2,
+                                       TEXT("name = \xFF\n"));
+  assert(err == MICRO_CONF_OK && strcmp(name, "\xFF") == 0);
+  free(name);
+  micro_conf_parser_destroy(&parser);
+}
+
+// A compiled syntax changes the comments and the separators, with
+// or without inline comments
+static void test_syntax(void)
+{
+  int a = 0, b = 0;
+  char *url = NULL;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &a, "a"},
+      {MICRO_CONF_INT, &b, "b"},
+      {MICRO_CONF_STR, &url, "url"},
+    };
+  MicroConfSyntax syntax = {0};
+  syntax.separators = "=";
+  syntax.comments = "; //";
+  MicroConfSyntaxTable table;
+  assert(micro_conf_syntax_compile(&table, &syntax) == MICRO_CONF_OK);
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.syntax = &table;
+  parser.flags = MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                           TEXT("; first\n"
+                                                "// second\n"
+                                                "a = 1 ; inline\n"
+                                                "b=2// inline\n"
+                                                "# not a comment\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY);
+  assert(a == 1 && b == 2 && parser.diag.line == 5);
+
+  // ':' is not a separator anymore
+  err = micro_conf_parser_parse_buffer(&parser, conf, 3, TEXT("a: 3\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY && a == 1);
+
+  syntax.no_inline_comments = true;
+  assert(micro_conf_syntax_compile(&table, &syntax) == MICRO_CONF_OK);
+  err = micro_conf_parser_parse_buffer(&parser, conf, 3,
+                                       TEXT("  ; comment\n"
+                                            "url = http://host;a\n"));
+  assert(err == MICRO_CONF_OK && strcmp(url, "http://host;a") == 0);
+  free(url);
+  micro_conf_parser_destroy(&parser);
+
+  MicroConfSyntax invalid = {0};
+  invalid.comments = "###";
+  assert(micro_conf_syntax_compile(&table, &invalid)
+         == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  invalid.comments = "// /*";
+  assert(micro_conf_syntax_compile(&table, &invalid)
+         == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  invalid.comments = NULL;
+  invalid.whitespace = " =";
+  assert(micro_conf_syntax_compile(&table, &invalid)
+         == MICRO_CONF_ERROR_INVALID_SCHEMA);
+  invalid.whitespace = " \n";
+  assert(micro_conf_syntax_compile(&table, &invalid)
+         == MICRO_CONF_ERROR_INVALID_SCHEMA);
+}
+
+// Short integers take the digit loop, the others strtol. Both agree,
+// and both reject what does not fit in an int.
+static void test_ints(void)
+{
+  int n[8] = {0};
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &n[0], "a"},
+      {MICRO_CONF_INT, &n[1], "b"},
+      {MICRO_CONF_INT, &n[2], "c"},
+      {MICRO_CONF_INT, &n[3], "d"},
+      {MICRO_CONF_INT, &n[4], "e"},
+      {MICRO_CONF_INT, &n[5], "f"},
+      {MICRO_CONF_INT, &n[6], "g"},
+      {MICRO_CONF_INT, &n[7], "h"},
+    };
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 8,
+    TEXT("a = 0\nb = +7\nc =\t -42 \t\nd = 007\ne = 2147483647\n"
+         "f = -2147483648\ng = 000000000000000000000012\n"
+         "h = -0000000000000000000000012\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(n[0] == 0 && n[1] == 7 && n[2] == -42 && n[3] == 7);
+  assert(n[4] == 2147483647 && n[5] == -2147483647 - 1);
+  assert(n[6] == 12 && n[7] == -12);
+
+  Errors errors = {0};
+  parser.on_error = on_error;
+  parser.on_error_user = &errors;
+  parser.flags = MICRO_CONF_FLAG_KEEP_GOING;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 8,
+    TEXT("a = -\nb = +\nc = 12a\nd = 1 2\ne = 0x10\nf = --1\ng = 1e3\n"
+         "h =\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT && errors.count == 8);
+
+  // Overflows, in the digit loop and in strtol
+  errors.count = 0;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 8,
+    TEXT("a = 2147483648\nb = -2147483649\nc = 99999999999\n"
+         "d = 999999999999999999\ne = 99999999999999999999999\n"
+         "f = -99999999999999999999999\n"));
+  assert(err == MICRO_CONF_ERROR_INVALID_INT && errors.count == 6);
+  assert(n[0] == 0 && n[1] == 7 && n[2] == -42 && n[3] == 7);
+  assert(n[4] == 2147483647 && n[5] == -2147483647 - 1);
+  parser.on_error = NULL;
+  parser.flags = 0;
+
+  char text[32];
+  for (long v = -100000; v <= 100000; v += 997)
+  {
+    int len = snprintf(text, sizeof(text), "a = %ld\n", v);
+    err = micro_conf_parser_parse_buffer(&parser, conf, 8, text,
+                                         (size_t)len);
+    assert(err == MICRO_CONF_OK && n[0] == (int)v);
+  }
+  micro_conf_parser_destroy(&parser);
+}
+
+// The adaptive order moves the keys found most often to the front,
+// and keeps it across the parses of the same entries
+static void test_adaptive(void)
+{
+  int a = 0, b = 0, c = 0, d = 0;
+  MicroConf conf[] =
+    {
+      {MICRO_CONF_INT, &a, "a"},
+      {MICRO_CONF_INT, &b, "b"},
+      {MICRO_CONF_INT, &c, "c"},
+      {MICRO_CONF_INT, &d, "d"},
+    };
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.flags = MICRO_CONF_FLAG_ADAPTIVE | MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, 4,
+                                           TEXT("d = 1\nd = 2\nc = 3\n"));
+  assert(err == MICRO_CONF_OK && c == 3 && d == 2);
+  assert(!parser.index.slots);
+  assert(parser.order[0] == 3 && parser.hits[0] == 2);
+  assert(parser.order[1] == 2 && parser.hits[1] == 1);
+  assert(parser.order[2] == 0 && parser.order[3] == 1);
+
+  err = micro_conf_parser_parse_buffer(&parser, conf, 4,
+                                       TEXT("c = 4\nc = 5\n"));
+  assert(err == MICRO_CONF_OK && c == 5);
+  assert(parser.order[0] == 2 && parser.hits[0] == 3);
+
+  // Counts are halved before they overflow
+  parser.hits[0] = UINT32_MAX;
+  err = micro_conf_parser_parse_buffer(&parser, conf, 4,
+                                       TEXT("c = 6\nabc = 7\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY && c == 6);
+  assert(parser.order[0] == 2 && parser.hits[0] == UINT32_MAX / 2 + 1);
+  assert(parser.hits[1] == 1);
+
+  // Other entries start over in declaration order
+  err = micro_conf_parser_parse_buffer(&parser, conf + 1, 3,
+                                       TEXT("b = 8\n"));
+  assert(err == MICRO_CONF_OK && b == 8);
+  assert(parser.order_len == 3 && parser.order[0] == 0);
+  assert(parser.hits[0] == 1 && parser.hits[2] == 0);
+  micro_conf_parser_destroy(&parser);
+}
+
+// The Bloom filter passes every known name and rejects most of the
+// others, while maps and patterns still see the keys it rejects
+static void test_filter(void)
+{
+  enum { NUM_CONF = 101 };
+  static int values[NUM_CONF];
+  static char names[NUM_CONF][24];  // "k" and any number
+  MicroConf conf[NUM_CONF];
+  MicroConfMap map = {0};
+  map.type = MICRO_CONF_INT;
+  for (int i = 0; i < NUM_CONF - 1; ++i)
+  {
+    snprintf(names[i], sizeof(names[i]), "k%d", i);
+    conf[i].type = MICRO_CONF_INT;
+    conf[i].value = &values[i];
+    conf[i].name = names[i];
+  }
+  conf[NUM_CONF - 1].type = MICRO_CONF_MAP;
+  conf[NUM_CONF - 1].value = &map;
+  conf[NUM_CONF - 1].name = "m";
+
+  Weights weights = {{0}, 0, 0};
+  MicroConfPattern patterns[] = {{"p.*", MICRO_CONF_INT, add_weight,
+                                  &weights}};
+  MicroConfPatternSet set;
+  assert(micro_conf_patterns_build(&set, micro_conf_allocator_default(),
+                                   patterns, 1) == MICRO_CONF_OK);
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  parser.patterns = &set;
+  int err = micro_conf_parser_parse_buffer(&parser, conf, NUM_CONF,
+                                           TEXT("k99 = 1\nm.x = 2\n"
+                                                "p.y = 3\nunknown = 4\n"));
+  assert(err == MICRO_CONF_OK);
+  assert(values[99] == 1 && micro_conf_map_get(&map, TEXT("x"))->i == 2);
+  assert(weights.calls == 1 && weights.sum == 3);
+  assert(parser.filter_words > 0);
+
+  size_t passed = 0;
+  char key[24];  // "other." and any int
+  for (int i = 0; i < NUM_CONF; ++i)
+    assert(_micro_conf_filter_has(&parser, _micro_conf_hash(
+      conf[i].name, strlen(conf[i].name))));
+  for (int i = 0; i < 1000; ++i)
+  {
+    int len = snprintf(key, sizeof(key), "other.%d", i);
+    passed += _micro_conf_filter_has(&parser,
+                                     _micro_conf_hash(key, (size_t)len));
+  }
+  assert(passed < 150);
+
+  parser.flags = MICRO_CONF_FLAG_UNKNOWN_KEYS;
+  err = micro_conf_parser_parse_buffer(&parser, conf, NUM_CONF,
+                                       TEXT("unknown = 4\n"));
+  assert(err == MICRO_CONF_ERROR_UNKNOWN_KEY);
+  micro_conf_parser_destroy(&parser);
+  micro_conf_patterns_destroy(&set);
+  micro_conf_map_destroy(&map);
+}
+
+// Every file gets its own result, and signals during the load do
+// not abandon the files in flight
+static void test_load_many(void)
+{
+  int a = 0, b = 0;
+  MicroConf conf_a[] = {{MICRO_CONF_INT, &a, "a"}};
+  MicroConf conf_b[] = {{MICRO_CONF_INT, &b, "b"}};
+  char path_a[32], path_b[32];
+  temp_file(path_a, "a = 1\n");
+  temp_file(path_b, "b = x\n");
+
+  MicroConfLoadJob jobs[] =
+    {
+      {.pathname = path_a, .conf = conf_a, .num_conf = 1},
+      {.pathname = path_b, .conf = conf_b, .num_conf = 1},
+      {.pathname = "/nonexistent/micro.conf", .conf = conf_a,
+       .num_conf = 1},
+    };
+  int err = micro_conf_load_many(jobs, 3, micro_conf_allocator_default());
+  assert(err == MICRO_CONF_ERROR_INVALID_INT);
+  assert(jobs[0].error == MICRO_CONF_OK && a == 1);
+  assert(jobs[1].error == MICRO_CONF_ERROR_INVALID_INT);
+  assert(jobs[1].diag.line == 1);
+  assert(jobs[2].error == MICRO_CONF_ERROR_OPENING_FILE);
+  unlink(path_a);
+  unlink(path_b);
+
+  // A FIFO keeps the open in flight while a child sends signals
+  char fifo[32];
+  temp_file(fifo, "");
+  unlink(fifo);
+  assert(mkfifo(fifo, 0600) == 0);
+  struct sigaction action, old_action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_signal;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, &old_action);
+
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0)
+  {
+    struct timespec delay = {0, 2000000};
+    for (int i = 0; i < 50; ++i)
+    {
+      kill(getppid(), SIGUSR1);
+      nanosleep(&delay, NULL);
+    }
+    int fd = open(fifo, O_WRONLY);
+    if (fd >= 0 && write(fd, "a = 5\n", 6) == 6) close(fd);
+    _exit(0);
+  }
+  MicroConfLoadJob job = {.pathname = fifo, .conf = conf_a, .num_conf = 1};
+  err = micro_conf_load_many(&job, 1, micro_conf_allocator_default());
+  // Let the child finish even if the load gave up on the FIFO
+  int unblock = open(fifo, O_RDONLY | O_NONBLOCK);
+  waitpid(child, NULL, 0);
+  if (unblock >= 0) close(unblock);
+  sigaction(SIGUSR1, &old_action, NULL);
+  unlink(fifo);
+  assert(err == MICRO_CONF_OK && a == 5);
+}
+
+int main(void)
+{
+  test_parser();
+  test_allocator();
+  test_arena();
+  test_load_many();
+  test_dry_run();
+  test_schema();
+  test_defaults();
+  test_required();
+  test_provenance();
+  test_keywords();
+  test_sorted();
+  test_prepared();
+  test_lazy();
+  test_patterns();
+  test_map();
+  test_history();
+  test_digest();
+  test_files();
+#ifdef MICRO_CONF_HAS_ATOMICS
+  test_publisher();
+  test_seqlock();
+#endif
+  test_utf8();
+  test_syntax();
+  test_ints();
+  test_adaptive();
+  test_filter();
+  printf("all checks passed\n");
+  return 0;
+}
@@ -88,6 +88,496 @@
 //    micro_conf_parse(config, num_conf, "micro.conf");
 //    if (err != MICRO_CONF_OK) return -err;
 //
+// An int outside of the range of `int` fails with
+// MICRO_CONF_ERROR_INVALID_INT. An empty value is not a number: `x =`
+// fails for an int, a float or a double, and sets a MICRO_CONF_STR to
+// the empty string.
+//
+// Boolean values can be written as true/false, yes/no, on/off or 1/0,
+// in any case. Other keywords can be parsed as a MICRO_CONF_STR and
+// looked up with `micro_conf_keyword_find`, which also ignores case:
+//
+//    const char *levels[] = {"debug", "info", "warn", "error"};
+//    size_t level = micro_conf_keyword_find(levels, 4, str, strlen(str));
+//
+//
+// Parser context
+// --------------
+//
+// `micro_conf_parse` is a convenience wrapper around a
+// `MicroConfParser`, which holds all the state of a parse: the key
+// index built from the `MicroConf` array, the line buffer and the
+// diagnostics of the last error. The library has no global state,
+// so different parsers can be used concurrently from different
+// threads. Keeping a parser around lets you reuse its warm buffers
+// and index across reloads:
+//
+//    MicroConfParser parser;
+//    micro_conf_parser_init(&parser);
+//
+//    int err = micro_conf_parser_parse(&parser, config, num_conf,
+//                                      "micro.conf");
+//    if (err != MICRO_CONF_OK)
+//      fprintf(stderr, "error %d at line %u\n",
+//              parser.diag.error, parser.diag.line);
+//
+//    micro_conf_parser_destroy(&parser);
+//
+// The index is rebuilt only when a different `MicroConf` array (or
+// size) is passed. Along with it, the parser builds a small Bloom
+// filter over the names, so that most of the unknown keys are
+// rejected with two bit tests before any string comparison. If
+// you modify the names of an array in place, or reorder it (for
+// example with `micro_conf_sort`), call `micro_conf_parser_destroy`
+// and `micro_conf_parser_init` again: the parser cannot tell, and
+// would match keys to the entries at their old positions.
+//
+// Input can also be given in memory with `micro_conf_parser_parse_buffer`,
+// or chunk by chunk with `micro_conf_parser_begin`,
+// `micro_conf_parser_feed` and `micro_conf_parser_end`; lines may
+// span chunk boundaries.
+//
+//
+// Allocators
+// ----------
+//
+// All the memory of a parser, including the strings of
+// MICRO_CONF_STR values, comes from a `MicroConfAllocator`. The
+// default one uses malloc, realloc and free. You can provide your
+// own (for example a pool), or use the built-in arena that allocates
+// from a fixed buffer and never touches the heap:
+//
+//    static unsigned char memory[4096];
+//    MicroConfArena arena;
+//    micro_conf_arena_init(&arena, memory, sizeof(memory));
+//
+//    MicroConfParser parser;
+//    micro_conf_parser_init_allocator(&parser,
+//                                     micro_conf_arena_allocator(&arena));
+//
+// When the allocator runs out of memory for the key index, lookups
+// fall back to a linear scan; any other allocation failure returns
+// MICRO_CONF_ERROR_OUT_OF_MEMORY.
+//
+//
+// Embedded mode
+// -------------
+//
+// Define MICRO_CONF_NO_MALLOC before including the library to build
+// it without any heap allocation and without stdio. In this mode:
+//
+//  - only in-memory input is supported, through
+//    `micro_conf_parser_parse_buffer` or the begin/feed/end API;
+//  - the line buffer is a fixed array of MICRO_CONF_LINE_MAX bytes
+//    inside the parser, longer lines fail with
+//    MICRO_CONF_ERROR_LINE_TOO_LONG;
+//  - the default allocator always fails, so pass a
+//    `micro_conf_arena_allocator` over your own storage to get a key
+//    index and MICRO_CONF_STR values.
+//
+// `make check-no-malloc` compiles the library in this mode and fails
+// if the object file references malloc, free, getline, strdup or
+// file I/O symbols.
+//
+//
+// Loading many files
+// ------------------
+//
+// `micro_conf_load_many` loads a list of files, each with its own
+// `MicroConf` array, and reports the result of every file:
+//
+//    MicroConfLoadJob jobs[] = {
+//      { .pathname = "a.conf", .conf = conf_a, .num_conf = num_a },
+//      { .pathname = "b.conf", .conf = conf_b, .num_conf = num_b },
+//    };
+//    int err = micro_conf_load_many(jobs, 2,
+//                                   micro_conf_allocator_default());
+//
+// If you define MICRO_CONF_IO_URING on Linux, the opens, reads and
+// closes of up to MICRO_CONF_LOAD_DEPTH files are submitted together
+// through io_uring, and every chunk is fed to the parser of its file
+// as soon as it arrives. Otherwise, or if the kernel does not
+// support io_uring or its opens and closes (before Linux 5.6), files
+// are read one after the other with read().
+//
+//
+// Validation
+// ----------
+//
+// Set `parser.flags` to change how a parse behaves:
+//
+//  - MICRO_CONF_FLAG_DRY_RUN validates the values without writing
+//    to any variable (and without allocating strings);
+//  - MICRO_CONF_FLAG_KEEP_GOING reports each error to
+//    `parser.on_error` and continues with the next line, the parse
+//    returns the first error;
+//  - MICRO_CONF_FLAG_UNKNOWN_KEYS makes keys that are not in the
+//    `MicroConf` array an error;
+//  - MICRO_CONF_FLAG_SORTED matches the keys of a sorted input
+//    against a `MicroConf` array sorted with `micro_conf_sort` in a
+//    single forward walk, without building the key index. If a key
+//    comes out of order, the index is built and used for the rest
+//    of the parse;
+//  - MICRO_CONF_FLAG_UTF8 rejects keys and string values that are not
+//    valid UTF-8;
+//  - MICRO_CONF_FLAG_ADAPTIVE matches keys with a linear scan that
+//    tries first the entries found most often, instead of building
+//    the index. It can be faster for small `MicroConf` arrays, and
+//    the parser keeps the order for the next parses.
+//
+// A UTF-8 byte order mark at the start of the input is skipped, and
+// lines can end with "\r\n".
+//
+// A schema can also be loaded at runtime from a file with
+// `micro_conf_schema_load`, so that tools and services share it as
+// data. Each entry has a type and optional default value and range:
+//
+//    # schema
+//    an_integer = int default=10 min=0 max=100
+//    a_str      = str default="a string" max=64
+//
+// The loaded `MicroConfSchema` keeps the entries, defaults, ranges and
+// all the strings in a single allocation, and builds its key index
+// once. `micro_conf_parser_use_schema` lets a parser share that index
+// and reject values out of range. Schema entries have no variables, so
+// they are meant to be used with MICRO_CONF_FLAG_DRY_RUN.
+//
+// `make` also builds `micro-conf-check`, a tool that validates many
+// config files in parallel against a schema and prints all the
+// errors:
+//
+//    ./micro-conf-check [-j threads] [-u] schema file...
+//
+//
+// Defaults
+// --------
+//
+// Instead of setting every default by hand, declare them in a
+// `MicroConfValue` table parallel to the `MicroConf` array and
+// apply them all at once before parsing:
+//
+//    MicroConfValue defaults[] = { {.i = 1}, {.i = 1} };
+//
+//    MicroConfDefaults plan;
+//    micro_conf_defaults_build(&plan, micro_conf_allocator_default(),
+//                              config, defaults, NULL, num_conf);
+//    micro_conf_apply_defaults(&plan);
+//
+// The plan is computed once: the defaults are laid out in an image
+// sorted by the address of their variables, and variables that are
+// next to each other in memory (like the fields of a struct) are
+// written by a single memcpy. Keep the plan to apply it again
+// before each reload.
+//
+// After a parse, `micro_conf_parser_from_file` tells whether an
+// entry was set by the file or kept its default.
+//
+//
+// Required keys
+// -------------
+//
+// Combine MICRO_CONF_REQUIRED with the type of an entry to make its
+// key mandatory:
+//
+//    {MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT), &vec.x, "vec.x"},
+//
+// If the key is not in the input, the parse fails with
+// MICRO_CONF_ERROR_MISSING_KEY and `micro_conf_parser_missing` lists
+// all the missing entries. A key with an invalid value is reported
+// for its value only, not as missing. The parser keeps a bitset of
+// the required entries next to the bitset of the keys found, so the
+// check at the end of a parse is one AND per 64 entries.
+//
+//
+// Provenance
+// ----------
+//
+// To know where each value came from, point `parser.provenance` to
+// an array of MicroConfProvenance with one element per entry, and
+// set `parser.source_id` before each parse:
+//
+//    MicroConfProvenance provenance[CONF_LEN] = {0};
+//    parser.provenance = provenance;
+//    parser.source_id = 0;   // system config
+//    micro_conf_parser_parse(&parser, conf, CONF_LEN, "/etc/app.conf");
+//    parser.source_id = 1;   // user config
+//    micro_conf_parser_parse(&parser, conf, CONF_LEN, "app.conf");
+//
+// Each set entry records the source, the line and the byte offset of
+// its value, so later layers override earlier ones.
+// `micro_conf_parser_provenance` returns the record of an entry. When
+// `provenance` is NULL nothing is tracked.
+//
+//
+// Prepared entries
+// ----------------
+//
+// For large `MicroConf` arrays, `micro_conf_prepare` copies the
+// entries into a structure of arrays: the hash slots, a packed pool
+// of names, the types and the variables each have their own array,
+// in a single allocation. A slot keeps the length and the offset of
+// its name next to the hash, so matching a key reads one slot per
+// probe and then the name. The types and variables of the other
+// entries stay out of the cache:
+//
+//    MicroConfPrepared prepared;
+//    micro_conf_prepare(&prepared, micro_conf_allocator_default(),
+//                       config, num_conf);
+//    micro_conf_parser_use_prepared(&parser, &prepared);
+//    micro_conf_parser_parse(&parser, config, num_conf, "micro.conf");
+//    ...
+//    micro_conf_prepared_destroy(&prepared);
+//
+// A prepared array can be shared by many parsers. `make bench`
+// compares it with the index over 10000 entries: the time of each
+// run and, on Linux when perf events are allowed, its cache misses.
+//
+//
+// Lazy values
+// -----------
+//
+// Values that are rarely read do not need to be converted at every
+// start. Mark their entry with MICRO_CONF_LAZY and point it to a
+// MicroConfLazy: the parse only copies the text of the value, and
+// `micro_conf_lazy_get` converts it on the first call and caches the
+// result:
+//
+//    MicroConfLazy trace_ratio = {0};
+//    trace_ratio.value.d = 0.01;   // default
+//
+//    {MICRO_CONF_LAZY_TYPE(MICRO_CONF_DOUBLE), &trace_ratio, "trace"},
+//
+//    MicroConfValue value;
+//    if (micro_conf_lazy_get(&trace_ratio, &value) == MICRO_CONF_OK)
+//      use(value.d);
+//    ...
+//    micro_conf_lazy_destroy(&trace_ratio);
+//
+// Invalid lazy values are reported by `micro_conf_lazy_get`, not by
+// the parse, except with MICRO_CONF_FLAG_DRY_RUN which converts and
+// validates every value. Lazy entries are skipped by defaults plans,
+// their default is `value`, which the parser never overwrites: it is
+// what `micro_conf_lazy_get` returns when the text is invalid.
+//
+//
+// Pattern keys
+// ------------
+//
+// Families of keys can be bound with a single pattern instead of
+// one entry per key. A pattern has one `*`, which matches any text,
+// and a callback that receives each converted value:
+//
+//    int set_weight(void *user, const char *key, size_t key_len,
+//                   const char *match, size_t match_len,
+//                   const MicroConfValue *value, size_t value_len);
+//
+//    MicroConfPattern patterns[] = {
+//      {"backend.*.weight", MICRO_CONF_INT, set_weight, backends},
+//    };
+//    MicroConfPatternSet set;
+//    micro_conf_patterns_build(&set, micro_conf_allocator_default(),
+//                              patterns, 1);
+//    parser.patterns = &set;
+//
+// Keys that are not in the `MicroConf` array are matched against the
+// patterns, and the first matching pattern in declaration order wins.
+// Patterns are kept in a hash table over the text before the `*`, so
+// a key is hashed once and the table is probed once per distinct
+// prefix length, instead of trying every pattern.
+//
+//
+// Maps
+// ----
+//
+// A MICRO_CONF_MAP entry collects all the keys that start with its
+// name and a dot into a MicroConfMap, an open addressing hash map of
+// typed values:
+//
+//    MicroConfMap limits = {0};
+//    limits.type = MICRO_CONF_INT;
+//
+//    {MICRO_CONF_MAP, &limits, "limits"},
+//
+//    # config
+//    limits.tenant_a = 100
+//    limits.tenant_b = 250
+//
+//    const MicroConfValue *limit = micro_conf_map_get(&limits, "tenant_a", 8);
+//    ...
+//    micro_conf_map_destroy(&limits);
+//
+// Keys and strings are copied with the allocator of the parser, so
+// a map can live in an arena. Keys that have their own entry, like
+// `limits.global`, are not added to the map.
+//
+//
+// Snapshots and rollback
+// ----------------------
+//
+// A MicroConfHistory keeps the last few applied configs, so that a
+// bad reload can be undone without parsing the old file again:
+//
+//    MicroConfHistory history;
+//    micro_conf_history_init(&history, micro_conf_allocator_default(),
+//                            config, num_conf, 8);
+//
+//    if (micro_conf_parser_parse(&parser, config, num_conf, path)
+//        == MICRO_CONF_OK)
+//      micro_conf_history_push(&history);
+//    ...
+//    micro_conf_rollback(&history, 1);   // back to the previous one
+//
+// Each snapshot records which entries changed since the previous
+// one, so a rollback writes only those. Strings are copied once and
+// shared by reference count between the snapshots where they are
+// equal. A rollback writes string variables with new copies, made
+// with the allocator of the history: the program owns and frees them,
+// like the strings written by a parse.
+//
+//
+// Verifying configs
+// -----------------
+//
+// A parser can check the input against a detached SHA-256 or
+// HMAC-SHA-256 digest, for example one made with
+// `openssl dgst -sha256 -hmac key`. The input is hashed as it is fed,
+// so verifying does not read the file twice:
+//
+//    MicroConfDigest digest;
+//    micro_conf_digest_init_hmac(&digest, key, key_len);
+//    parser.digest = &digest;
+//    parser.expected_digest = signature;   // MICRO_CONF_DIGEST_SIZE bytes
+//
+//    int err = micro_conf_parser_parse(&parser, config, num_conf, path);
+//
+// With an expected digest the values are checked but not written
+// while parsing. The valid lines are kept, and replayed only if the
+// digest of the whole input matches and the parse found no error, not
+// even a missing required key or a line skipped with
+// MICRO_CONF_FLAG_KEEP_GOING. If the digest differs, the parse fails
+// with MICRO_CONF_ERROR_DIGEST_MISMATCH. Either way no variable is
+// changed. Dry runs check the digest too. The digest must be initialized again
+// before each parse.
+//
+//
+// Loaders
+// -------
+//
+// A MicroConfLoader reads the text of a config in chunks, from any
+// source. `micro_conf_parser_parse_loader` feeds each chunk to the
+// parser as it is read, so the whole text is never in memory:
+//
+//    static int read_socket(void *user, char *buffer, size_t size,
+//                           size_t *read) { ... }
+//
+//    MicroConfLoader loader = { .read = read_socket, .user = &socket };
+//    int err = micro_conf_parser_parse_loader(&parser, config,
+//                                             num_conf, &loader);
+//
+// If you define MICRO_CONF_ZLIB and link with -lz, MicroConfGzip
+// wraps a loader and decompresses gzip or zlib data as it is read,
+// and `micro_conf_parse` reads .gz files directly:
+//
+//    MicroConfGzip gzip;
+//    micro_conf_gzip_init(&gzip, file_loader);
+//    MicroConfLoader loader = micro_conf_gzip_loader(&gzip);
+//    int err = micro_conf_parser_parse_loader(&parser, config,
+//                                             num_conf, &loader);
+//    micro_conf_gzip_destroy(&gzip);
+//
+// Files are sniffed for the gzip magic as they are read, without
+// seeking, so pipes work too. The memory of zlib comes from the
+// allocator of the parser, or from the one given to
+// `micro_conf_gzip_init_allocator`.
+//
+//
+// Publishing to readers
+// ---------------------
+//
+// A MicroConfPublisher copies the values of the variables after a
+// reload, so other threads can read a consistent set of values while
+// the next reload writes the variables:
+//
+//    MicroConfPublisher publisher;
+//    micro_conf_publisher_init(&publisher, micro_conf_allocator_default(),
+//                              config, num_conf);
+//    micro_conf_parse(config, num_conf, "micro.conf");
+//    micro_conf_publish(&publisher);
+//
+// Each reader thread keeps its own MicroConfReader, for example in a
+// `static __thread` variable or in the state of a worker:
+//
+//    const MicroConfValue *values = micro_conf_reader_get(&reader);
+//    int threads = values[THREADS].i;
+//
+// The reader holds a reference to the values it returned, and
+// compares its generation with the one of the publisher on each
+// call. Only when something new was published does it take a lock
+// and swap the references; otherwise a call is a single relaxed load.
+// The allocator must be thread safe, since the last reader to drop
+// some values frees them. The atomic operations are the __atomic
+// builtins of GCC and Clang. With other compilers, publishers and the
+// seqlocks below are left out and MICRO_CONF_HAS_ATOMICS is not
+// defined; the rest of the library is unchanged.
+//
+//
+// In-place updates
+// ----------------
+//
+// Configs made only of scalars can be reloaded in place while other
+// threads read the variables, without copying them. Set a
+// MicroConfSeqlock on the parser: the lines are checked and converted
+// as they are read, and the values are all copied to the variables at
+// the end of the parse, while the sequence of the seqlock is odd.
+// Readers retry if a parse wrote the variables while they were reading
+// them:
+//
+//    MicroConfSeqlock seqlock = {0};
+//    parser.seqlock = &seqlock;
+//    micro_conf_parser_parse(&parser, config, num_conf, "micro.conf");
+//
+//    // In a reader thread
+//    uint32_t sequence;
+//    do {
+//      sequence = micro_conf_seqlock_read_begin(&seqlock);
+//      x = vec_x;
+//      y = vec_y;
+//    } while (micro_conf_seqlock_read_retry(&seqlock, sequence));
+//
+// If the parse fails, no variable is written, also when a required
+// key is missing or MICRO_CONF_FLAG_KEEP_GOING skipped a line. The
+// parse fails with MICRO_CONF_ERROR_INVALID_SCHEMA if an entry is a
+// string, a map or lazy. The variables are written with relaxed
+// atomic stores, so readers can load them with
+// `__atomic_load_n(&x, __ATOMIC_RELAXED)`, or with plain loads where
+// aligned scalars are read in one access. Pattern callbacks are called
+// as the lines are read, outside of the write.
+//
+//
+// Syntax
+// ------
+//
+// The characters of the syntax can be changed, for configs written
+// for other tools. A MicroConfSyntax is compiled once in a table of
+// character classes, which the parser walks the same way as the
+// default one:
+//
+//    MicroConfSyntax syntax = {
+//      .separators = "=",
+//      .comments = "; //",
+//      .no_inline_comments = true,  // values can contain ';'
+//    };
+//    MicroConfSyntaxTable table;
+//    micro_conf_syntax_compile(&table, &syntax);
+//    parser.syntax = &table;
+//
+// Comment markers have one or two bytes. Without
+// `no_inline_comments`, a comment can also start after a value.
+//
+// The default syntax uses a built-in table, which every scanner of the
+// library shares, also to read the digits of ints. `make bench` compares
+// it with per-byte comparisons on a long indented config.
+//
 //
 // Code
 // ----
@@ -102,11 +592,12 @@
 //     https://github.com/San7o/micro-headers
 //
 
+
 #ifndef MICRO_CONF
 #define MICRO_CONF
 
 #define MICRO_CONF_MAJOR 0
-#define MICRO_CONF_MINOR 1
+#define MICRO_CONF_MINOR 2
 
 #ifdef __cplusplus
 extern "C" {
@@ -122,11 +613,108 @@ extern "C" {
 #ifndef MICRO_CONF_DEF
   #define MICRO_CONF_DEF extern
 #endif
+
+// Conf: Size of the chunks read from a file
+#ifndef MICRO_CONF_READ_SIZE
+  #define MICRO_CONF_READ_SIZE 4096
+#endif
+
+// Conf: Define this to build without heap and without stdio. Only
+// in-memory input is supported, lines are limited to
+// MICRO_CONF_LINE_MAX bytes and all the memory comes from a
+// caller-provided allocator such as MicroConfArena.
+//
+//   #define MICRO_CONF_NO_MALLOC
+
+// Conf: Maximum length of a line, with MICRO_CONF_NO_MALLOC
+#ifndef MICRO_CONF_LINE_MAX
+  #define MICRO_CONF_LINE_MAX 256
+#endif
+
+// Conf: Define this to let `micro_conf_load_many` use io_uring on
+// Linux. If io_uring is not available at runtime, or if this is not
+// defined, files are loaded with plain read() calls.
+//
+//   #define MICRO_CONF_IO_URING
+
+// Conf: Define this, and link with -lz, to read gzip compressed
+// files. `micro_conf_parse` and `micro_conf_parser_parse` then
+// decompress the files that start with the gzip magic bytes.
+//
+//   #define MICRO_CONF_ZLIB
+
+// Conf: Number of files loaded at the same time by
+// `micro_conf_load_many` with io_uring
+#ifndef MICRO_CONF_LOAD_DEPTH
+  #define MICRO_CONF_LOAD_DEPTH 64
+#endif
+
+// Conf: Alignment of the allocations of MicroConfArena
+#ifndef MICRO_CONF_ARENA_ALIGN
+  #define MICRO_CONF_ARENA_ALIGN 16
+#endif
+
+// Conf: Number of entries whose state a parser tracks without
+// allocating memory
+#ifndef MICRO_CONF_INLINE_ENTRIES
+  #define MICRO_CONF_INLINE_ENTRIES 256
+#endif
+
+// Defined if the compiler has the __atomic builtins of GCC and Clang.
+// Publishers, their readers and seqlocks are built on them, and are
+// left out otherwise.
+#if defined(__GNUC__) || defined(__clang__)
+  #define MICRO_CONF_HAS_ATOMICS
+#endif
   
 //
 // Macros
 //
 
+// Number of 64 bit words of a bitset of [n] bits
+#define MICRO_CONF_BITSET_WORDS(n) (((n) + 63) / 64)
+
+// Flags that can be combined with the type of an entry
+//
+//    {MICRO_CONF_REQUIRED_TYPE(MICRO_CONF_INT), &x, "x"}
+//
+// The key of the entry must be present in the input, or the parse
+// fails with MICRO_CONF_ERROR_MISSING_KEY
+#define MICRO_CONF_REQUIRED 0x100
+#define MICRO_CONF_REQUIRED_TYPE(type) \
+  ((MicroConfType)((type) | MICRO_CONF_REQUIRED))
+// The variable of the entry is a MicroConfLazy: the parse only copies
+// the text of the value, which is converted on the first
+// `micro_conf_lazy_get`
+#define MICRO_CONF_LAZY 0x200
+#define MICRO_CONF_LAZY_TYPE(type) \
+  ((MicroConfType)((type) | MICRO_CONF_LAZY))
+// Get the type of an entry without its flags
+#define MICRO_CONF_TYPE(type) ((MicroConfType)((type) & 0xff))
+
+// Parser flags, set them in MicroConfParser.flags
+
+// Validate the input without writing to the variables
+#define MICRO_CONF_FLAG_DRY_RUN       (1u << 0)
+// Report invalid values and unknown keys through
+// MicroConfParser.on_error and continue with the next line. The
+// parse still returns the first error.
+#define MICRO_CONF_FLAG_KEEP_GOING    (1u << 1)
+// Fail with MICRO_CONF_ERROR_UNKNOWN_KEY on keys that are not in the
+// MicroConf array
+#define MICRO_CONF_FLAG_UNKNOWN_KEYS  (1u << 2)
+// The MicroConf array is sorted with `micro_conf_sort` and the input
+// is expected in the same order: match keys by walking both at the
+// same time instead of using the index
+#define MICRO_CONF_FLAG_SORTED        (1u << 3)
+// Fail with MICRO_CONF_ERROR_INVALID_UTF8 on keys, and on values of
+// MICRO_CONF_STR entries, that are not valid UTF-8
+#define MICRO_CONF_FLAG_UTF8          (1u << 4)
+// Match keys with a linear scan instead of the index, trying first
+// the entries found most often. The order is kept across parses of
+// the same MicroConf array.
+#define MICRO_CONF_FLAG_ADAPTIVE      (1u << 5)
+
 //
 // Errors
 //
@@ -141,12 +729,26 @@ extern "C" {
 #define MICRO_CONF_ERROR_INVALID_DOUBLE  -7
 #define MICRO_CONF_ERROR_INVALID_FLOAT   -8
 #define MICRO_CONF_ERROR_INVALID_CHAR    -9
-#define _MICRO_CONF_ERROR_MAX            -10
+#define MICRO_CONF_ERROR_OUT_OF_MEMORY   -10
+#define MICRO_CONF_ERROR_READING_FILE    -11
+#define MICRO_CONF_ERROR_PARSER_NULL     -12
+#define MICRO_CONF_ERROR_LINE_TOO_LONG   -13
+#define MICRO_CONF_ERROR_UNKNOWN_KEY     -14
+#define MICRO_CONF_ERROR_INVALID_SCHEMA  -15
+#define MICRO_CONF_ERROR_OUT_OF_RANGE    -16
+#define MICRO_CONF_ERROR_MISSING_KEY     -17
+#define MICRO_CONF_ERROR_DIGEST_MISMATCH -18
+#define MICRO_CONF_ERROR_INVALID_UTF8    -19
+#define _MICRO_CONF_ERROR_MAX            -20
 
 //
 // Types
 //
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef enum {
   MICRO_CONF_BOOL,
   MICRO_CONF_INT,
@@ -154,6 +756,7 @@ typedef enum {
   MICRO_CONF_DOUBLE,
   MICRO_CONF_CHAR,
   MICRO_CONF_STR,
+  MICRO_CONF_MAP,
 } MicroConfType;
   
 typedef struct {
@@ -162,12 +765,448 @@ typedef struct {
   char* name;
 } MicroConf;
 
+// A converted value of any MicroConfType
+typedef union {
+  bool b;
+  int i;
+  float f;
+  double d;
+  char c;
+  const char *s;
+} MicroConfValue;
+
+// Allocator used for all the memory of a parser. [alloc] and
+// [realloc] return NULL on failure. [realloc] and [free] receive the
+// size of the allocation, so that arenas and pools do not have to
+// track it. [free] may be NULL if the memory is released in bulk.
+typedef struct {
+  void* (*alloc)(void *user, size_t size);
+  void* (*realloc)(void *user, void *ptr, size_t old_size, size_t new_size);
+  void  (*free)(void *user, void *ptr, size_t size);
+  void *user;
+} MicroConfAllocator;
+
+// Variable of a MICRO_CONF_LAZY entry. Set [value] to the default
+// before parsing, and release it with `micro_conf_lazy_destroy`.
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConfType type;
+  char *text;  // Text of the value, NULL if the key was not set
+  size_t len;
+  size_t cap;
+  bool converted;  // Whether [cached] holds the conversion of [text]
+  int error;  // Result of the conversion
+  MicroConfValue cached;
+  MicroConfValue value;  // Default, never written by the parser
+} MicroConfLazy;
+
+// A key of a MicroConfMap, [key] is NULL if the slot is empty
+typedef struct {
+  uint32_t hash;
+  uint32_t key_len;
+  char *key;
+  MicroConfValue value;
+} MicroConfMapSlot;
+
+// Variable of a MICRO_CONF_MAP entry, which collects all the keys
+// starting with the name of the entry and a dot. Set [type] to the
+// type of the values before parsing, and release it with
+// `micro_conf_map_destroy`.
+typedef struct {
+  MicroConfType type;
+  MicroConfAllocator allocator;
+  MicroConfMapSlot *slots;
+  size_t capacity;  // Power of two
+  size_t count;
+} MicroConfMap;
+
+// Bump allocator over a fixed, caller-provided buffer
+typedef struct {
+  unsigned char *buffer;
+  size_t size;
+  size_t used;
+  size_t last;  // Offset of the last allocation, for in-place growth
+} MicroConfArena;
+
+// A slot of the key index, [entry] is the index in the MicroConf
+// array plus one, or 0 if the slot is empty
+typedef struct {
+  uint32_t hash;
+  uint32_t entry;
+} MicroConfSlot;
+
+// Open addressing hash index over the names of a MicroConf array
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConfSlot *slots;
+  size_t capacity;  // Power of two, 0 if the index is not built
+} MicroConfIndex;
+
+// A slot of a prepared array. It holds the length and the offset of
+// the name next to the hash, so a probe reads a single slot and then
+// the name. [entry] is the index in the MicroConf array plus one, or
+// 0 if the slot is empty
+typedef struct {
+  uint32_t hash;
+  uint32_t length;
+  uint32_t name_offset;
+  uint32_t entry;
+} MicroConfPreparedSlot;
+
+// A MicroConf array prepared for matching, with each field in its
+// own array. Lookups touch only the slots and the names pool, the
+// type and the variable are read once a key matched.
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConf *conf;  // The array it was prepared from
+  size_t num_conf;
+  MicroConfPreparedSlot *slots;
+  size_t capacity;         // Power of two
+  uint32_t *name_offsets;  // Offset of each name in [names]
+  char *names;             // All the names, NUL-terminated
+  MicroConfType *types;
+  void **targets;
+  void *memory;  // Single allocation holding all the arrays
+  size_t memory_size;
+} MicroConfPrepared;
+
+// Called for every key matched by a pattern, with the converted
+// [value] of [value_len] bytes. [match] is the part of the key
+// matched by `*`. MICRO_CONF_STR values and the key are only valid
+// during the call. Returns MICRO_CONF_OK, or an error to fail the
+// parse.
+typedef int (*MicroConfPatternFn)(void *user, const char *key,
+                                  size_t key_len, const char *match,
+                                  size_t match_len,
+                                  const MicroConfValue *value,
+                                  size_t value_len);
+
+// Binds all the keys matching [pattern], which has exactly one `*`
+// matching any text, for example "backend.*.weight"
+typedef struct {
+  const char *pattern;
+  MicroConfType type;
+  MicroConfPatternFn callback;
+  void *user;
+} MicroConfPattern;
+
+// Patterns compiled for lookup: a hash table over the text before
+// the `*`, probed once for each distinct prefix length
+typedef struct {
+  MicroConfAllocator allocator;
+  const MicroConfPattern *patterns;
+  size_t num_patterns;
+  MicroConfSlot *slots;
+  size_t capacity;       // Power of two, 0 if not built
+  uint32_t *prefix_len;  // Bytes before the `*` of each pattern
+  uint32_t *suffix_len;  // Bytes after the `*` of each pattern
+  uint32_t *lengths;     // Distinct prefix lengths, ascending
+  size_t num_lengths;
+  void *memory;
+  size_t memory_size;
+} MicroConfPatternSet;
+
+// Where and why the last error happened
+typedef struct {
+  int error;
+  unsigned int line;    // 1-based, 0 if not related to a line
+  unsigned int column;  // 1-based, 0 if not related to a line
+  size_t entry;         // Index in the MicroConf array, or (size_t)-1
+} MicroConfDiagnostic;
+
+// Size in bytes of a SHA-256 digest
+#define MICRO_CONF_DIGEST_SIZE 32
+
+// Streaming SHA-256, or HMAC-SHA-256 if initialized with a key
+typedef struct {
+  uint32_t state[8];
+  uint64_t length;  // Bytes hashed
+  unsigned char block[64];
+  size_t block_len;
+  unsigned char key[64];  // HMAC key padded to a block
+  bool hmac;
+} MicroConfDigest;
+
+// Characters of the syntax of a config. NULL members keep the
+// default syntax.
+typedef struct {
+  const char *whitespace;  // Default " \t"
+  const char *separators;  // Between a key and its value, default "=:"
+  // Comment markers of one or two bytes separated by spaces, such
+  // as "# ; //". Default "#".
+  const char *comments;
+  // Comments start only at the beginning of a line, so values can
+  // contain comment markers
+  bool no_inline_comments;
+} MicroConfSyntax;
+
+#define MICRO_CONF_CLASS_SPACE     (1u << 0)
+#define MICRO_CONF_CLASS_SEPARATOR (1u << 1)
+#define MICRO_CONF_CLASS_COMMENT   (1u << 2)
+// Printable or non-ASCII, and not in any of the classes above
+#define MICRO_CONF_CLASS_KEY       (1u << 3)
+#define MICRO_CONF_CLASS_DIGIT     (1u << 4)
+
+// A MicroConfSyntax compiled in a table of character classes
+typedef struct {
+  unsigned char classes[256];  // MICRO_CONF_CLASS_
+  // Second byte of the comment marker that starts with each byte, 0
+  // if the marker is a single byte
+  unsigned char comment_next[256];
+  // The byte that starts all the comment markers, 0 if they start
+  // with different bytes
+  unsigned char comment_start;
+  bool inline_comments;
+} MicroConfSyntaxTable;
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+// Sequence counter of variables written in place while other
+// threads read them. It is odd while a parse writes the variables.
+typedef struct {
+  uint32_t sequence;
+} MicroConfSeqlock;
+#endif
+
+// A line parsed while verifying a digest, replayed once it matches
+typedef struct {
+  size_t text;  // Offset in the staging text
+  size_t len;
+  uint64_t offset;
+  unsigned int line;
+} MicroConfStaged;
+
+// A converted value kept until the write of a seqlock
+typedef struct {
+  void *target;
+  MicroConfType type;
+  MicroConfValue value;
+} MicroConfStagedValue;
+
+// Where the value of an entry was set
+typedef struct {
+  uint32_t source;  // MicroConfParser.source_id of the parse
+  uint32_t line;    // 1-based, 0 if the entry was never set
+  uint64_t offset;  // Byte offset of the value in the source
+} MicroConfProvenance;
+
+// Called for every error of a parse, with the text of the line where
+// it happened
+typedef void (*MicroConfErrorFn)(void *user, const MicroConfDiagnostic *diag,
+                                 const char *line);
+
+// Called for every converted value of the entry [entry], before it
+// is stored. [len] is the length of the value in the file. Returns
+// MICRO_CONF_OK to accept the value, or an error.
+typedef int (*MicroConfValidateFn)(void *user, size_t entry,
+                                   const MicroConfValue *value, size_t len);
+
+// State of a parse. Initialize it with `micro_conf_parser_init` and
+// release it with `micro_conf_parser_destroy`. A parser must not
+// be used by more than one thread at a time.
+typedef struct {
+  MicroConfAllocator allocator;
+  unsigned int flags;  // MICRO_CONF_FLAG_
+  MicroConfErrorFn on_error;
+  void *on_error_user;
+  MicroConfValidateFn validate;
+  void *validate_user;
+  MicroConf *conf;
+  size_t num_conf;
+  MicroConfIndex index;
+  const MicroConfIndex *shared_index;  // Used instead of [index] if set
+  const MicroConfPrepared *prepared;   // Used instead of [index] if set
+  // Keys not in the MicroConf array are matched against these, if set
+  const MicroConfPatternSet *patterns;
+  const MicroConfSyntaxTable *syntax;  // The default syntax if NULL
+  size_t num_maps;  // MICRO_CONF_MAP entries of [conf]
+  // With MICRO_CONF_FLAG_SORTED, the first entry not before the last
+  // key, and whether the input has been in order so far
+  size_t cursor;
+  bool in_order;
+  // With MICRO_CONF_FLAG_ADAPTIVE, the entries in the order they are
+  // tried, and how many times each of them was found
+  uint32_t *order;
+  uint32_t *hits;
+  size_t order_len;
+  // Bloom filter over the names of [conf], which rejects most of the
+  // unknown keys before a lookup. Not used if [filter_words] is 0.
+  uint64_t *filter;
+  size_t filter_words;  // Power of two
+  // Line assembly buffer, reused across parses
+#ifdef MICRO_CONF_NO_MALLOC
+  char line[MICRO_CONF_LINE_MAX];
+#else
+  char *line;
+#endif
+  size_t line_len;
+  size_t line_cap;
+  unsigned int line_number;
+  uint64_t offset;       // Bytes of input consumed
+  uint64_t line_offset;  // Offset of the start of the current line
+  // If not NULL, one MicroConfProvenance per entry, updated every
+  // time an entry is set. It is not cleared between parses, so that
+  // layered configs keep the origin of each value.
+  MicroConfProvenance *provenance;
+  uint32_t source_id;
+  // If not NULL, all the input is hashed in [digest]. If
+  // [expected_digest] is also set, values are written only after the
+  // digest of the whole input matches its MICRO_CONF_DIGEST_SIZE
+  // bytes.
+  MicroConfDigest *digest;
+  const unsigned char *expected_digest;
+#ifdef MICRO_CONF_HAS_ATOMICS
+  // If not NULL, values are converted while parsing and written only
+  // at the end of the parse, all at once, inside a write of
+  // [seqlock]. All the entries must be scalars.
+  MicroConfSeqlock *seqlock;
+#endif
+  bool staging;
+  bool replaying;  // The staged lines are parsed again
+  MicroConfStaged *staged;
+  size_t num_staged;
+  size_t staged_cap;
+  char *stage_text;
+  size_t stage_len;
+  size_t stage_cap;
+  MicroConfStagedValue *staged_values;
+  size_t num_staged_values;
+  size_t staged_values_cap;
+  MicroConfDiagnostic diag;  // First error of the parse
+  size_t num_errors;
+  bool halted;
+  // Bitsets of the entries set by the input, of the entries whose key
+  // is in the input even if their value failed, and of the required
+  // entries, one after the other. They are in [bits_inline], or in
+  // [bits] if there are more than MICRO_CONF_INLINE_ENTRIES entries.
+  uint64_t bits_inline[3 * MICRO_CONF_BITSET_WORDS(MICRO_CONF_INLINE_ENTRIES)];
+  uint64_t *bits;
+  size_t bits_cap;  // Words allocated in [bits]
+  bool required_ready;  // The required bitset matches [conf]
+} MicroConfParser;
+
+// A memcpy from the image of a MicroConfDefaults
+typedef struct {
+  void *dst;
+  size_t offset;  // In the image
+  size_t size;
+} MicroConfCopy;
+
+// Precomputed plan to write the default values of a MicroConf array.
+// Variables next to each other in memory are written by a single
+// copy.
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConfCopy *copies;
+  size_t num_copies;
+  size_t copies_cap;
+  unsigned char *image;  // The default values, in the order of the copies
+  size_t image_size;
+} MicroConfDefaults;
+
+// Header of a string shared by the snapshots of a MicroConfHistory,
+// followed by its NUL-terminated bytes
+typedef struct {
+  uint32_t refs;  // Snapshots that hold the string
+  uint32_t len;
+} MicroConfString;
+
+// Values of all the entries at one point in time
+typedef struct {
+  MicroConfValue *values;
+  uint32_t *changed;  // Entries that differ from the previous snapshot
+  size_t num_changed;
+  uint64_t version;
+  bool used;  // Holds strings, until its slot is reused
+} MicroConfSnapshot;
+
+// Ring of the last [depth] snapshots of the variables of [conf]
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConf *conf;
+  size_t num_conf;
+  MicroConfSnapshot *ring;
+  size_t depth;
+  size_t head;   // Latest snapshot
+  size_t count;  // Snapshots that can be rolled back to, with [head]
+  uint64_t version;
+  uint64_t *seen;  // Scratch bitset for rollbacks
+  char **copies;   // Strings copied by a rollback, before it writes
+  void *memory;
+  size_t memory_size;
+} MicroConfHistory;
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+// Values of the variables published by a MicroConfPublisher. It is
+// never modified, and freed when the last reader drops it. The
+// strings are stored after the values, in the same allocation.
+typedef struct {
+  uint32_t refs;  // The publisher and the readers that hold it
+  size_t num_conf;
+  MicroConfValue *values;
+  size_t size;
+} MicroConfPublished;
+
+// Shares the values of the variables of [conf] with reader threads
+typedef struct {
+  MicroConfAllocator allocator;  // Must be thread safe
+  const MicroConf *conf;
+  size_t num_conf;
+  MicroConfPublished *current;
+  uint64_t generation;  // Incremented by each publish
+  int lock;             // Taken when [current] changes hands
+} MicroConfPublisher;
+
+// Cache of the values of a publisher, owned by a single thread
+typedef struct {
+  MicroConfPublisher *publisher;
+  MicroConfPublished *published;
+  uint64_t generation;
+} MicroConfReader;
+#endif // MICRO_CONF_HAS_ATOMICS
+
+#define MICRO_CONF_RANGE_MIN (1u << 0)
+#define MICRO_CONF_RANGE_MAX (1u << 1)
+
+// Accepted range of a number, or of the length of a string
+typedef struct {
+  double min;
+  double max;
+  unsigned int flags;  // MICRO_CONF_RANGE_
+} MicroConfRange;
+
+// A MicroConf array loaded from a schema file, with the default
+// value and the range of each entry. The entries, defaults, ranges
+// and the strings of names and defaults share a single allocation.
+// Entries have no variable, so the schema is meant for validation
+// with MICRO_CONF_FLAG_DRY_RUN.
+typedef struct {
+  MicroConfAllocator allocator;
+  MicroConf *conf;
+  size_t num_conf;
+  MicroConfValue *defaults;
+  bool *has_default;
+  MicroConfRange *ranges;
+  MicroConfIndex index;
+  void *memory;
+  size_t memory_size;
+  MicroConfDiagnostic diag;  // Where loading failed
+} MicroConfSchema;
+
+// A file loaded by `micro_conf_load_many`. [error] and [diag] are
+// set by the loader.
+typedef struct {
+  const char *pathname;
+  MicroConf *conf;
+  size_t num_conf;
+  int error;
+  MicroConfDiagnostic diag;
+} MicroConfLoadJob;
+
 //
 // Function declarations
 //
 
-#include <stddef.h>
-#include <stdbool.h>
+#ifndef MICRO_CONF_NO_MALLOC
 
 // Parse [pathname] with a specified [conf] of [num_conf] values
 // Returns MICRO_CONF_OK on success, or a MICRO_CONF_ERROR_ otherwise
@@ -176,178 +1215,4504 @@ typedef struct {
 // should free it
 MICRO_CONF_DEF int
 micro_conf_parse(MicroConf *conf, size_t num_conf, const char *pathname);
-  
-//
-// Implementation
-//
-  
-#ifdef MICRO_CONF_IMPLEMENTATION
 
-#define _POSIX_C_SOURCE 200809L
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#endif // MICRO_CONF_NO_MALLOC
 
-// Get the number of separator characters from the left of [input]
-// until the first non-separator or [input_size]. Separator characters
-// are specs, new lines and tabs. Updates [line] and/or [column] if
-// non null.
-int left_space(const char* input, int input_size,
-               unsigned int* line, unsigned int* column)
-{
-  if (!input || input_size == 0) return 0;
+// Initialize an empty [parser] using the default allocator
+MICRO_CONF_DEF void
+micro_conf_parser_init(MicroConfParser *parser);
 
-  int pos = 0;
-  while(pos < input_size &&
-        (input[pos] == ' ' ||
-         input[pos] == '\n' ||
-         input[pos] == '\t'))
-  {
-    if (input[pos] == '\n') {
-      if (line) (*line)++;
-      if (column) *column = 0;
-    } else {
-      if (column) (*column)++;
-    }
-    pos++;
-  }
+// Initialize an empty [parser] that gets all its memory, including
+// the MICRO_CONF_STR values, from [allocator]
+MICRO_CONF_DEF void
+micro_conf_parser_init_allocator(MicroConfParser *parser,
+                                 MicroConfAllocator allocator);
 
-  return pos;
-}
-  
-MICRO_CONF_DEF int
-micro_conf_parse(MicroConf *conf, size_t num_conf, const char *pathname)
-{
-  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+// Release all the memory owned by [parser]
+MICRO_CONF_DEF void
+micro_conf_parser_destroy(MicroConfParser *parser);
 
-  FILE *file = fopen(pathname, "r");
-  if (!file) return MICRO_CONF_ERROR_OPENING_FILE;
+#ifndef MICRO_CONF_NO_MALLOC
 
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t read;
+// Same as `micro_conf_parse`, using the buffers of [parser]. On
+// error, parser->diag tells where the error happened.
+MICRO_CONF_DEF int
+micro_conf_parser_parse(MicroConfParser *parser, MicroConf *conf,
+                        size_t num_conf, const char *pathname);
 
-  while ((read = getline(&line, &len, file)) >= 0)
-  {
-    char *comment = strchr(line, '#');
-    if (comment) *comment = '\0';
+#endif // MICRO_CONF_NO_MALLOC
 
-    int space = left_space(line, (int)read, NULL, NULL);
-    char *trimmed = line + space;
+// Parse [size] bytes of config text from [buffer]
+MICRO_CONF_DEF int
+micro_conf_parser_parse_buffer(MicroConfParser *parser, MicroConf *conf,
+                               size_t num_conf, const char *buffer,
+                               size_t size);
 
-    if (*trimmed == '\0' || *trimmed == '\n') continue;
+// Start an incremental parse of [conf] with [num_conf] values
+MICRO_CONF_DEF int
+micro_conf_parser_begin(MicroConfParser *parser, MicroConf *conf,
+                        size_t num_conf);
 
-    for (size_t i = 0; i < num_conf; ++i)
-    {
-      size_t name_len = strlen(conf[i].name);
-      if (strncmp(trimmed, conf[i].name, name_len) != 0)
-        continue;
+// Parse the next [size] bytes of [data]. Lines can span multiple
+// calls. After an error, further calls return the same error.
+MICRO_CONF_DEF int
+micro_conf_parser_feed(MicroConfParser *parser, const char *data,
+                       size_t size);
 
-      char *after_name = trimmed + name_len;
-      space = left_space(after_name, (int)(read - space - name_len), NULL, NULL);
-      after_name += space;
+// Parse the last unterminated line, if any, and finish the parse
+MICRO_CONF_DEF int
+micro_conf_parser_end(MicroConfParser *parser);
+
+// Reads the text of a config chunk by chunk. [read] writes up to
+// [size] bytes to [buffer] and sets [*read] to their number, which
+// is 0 at the end of the input. It returns MICRO_CONF_OK or an error.
+typedef struct {
+  int (*read)(void *user, char *buffer, size_t size, size_t *read);
+  void *user;
+} MicroConfLoader;
+
+// Parse the text produced by [loader], MICRO_CONF_READ_SIZE bytes
+// at a time
+MICRO_CONF_DEF int
+micro_conf_parser_parse_loader(MicroConfParser *parser, MicroConf *conf,
+                               size_t num_conf,
+                               const MicroConfLoader *loader);
+
+#ifdef MICRO_CONF_ZLIB
+
+#ifdef MICRO_CONF_NO_MALLOC
+  #error "MICRO_CONF_ZLIB cannot be used with MICRO_CONF_NO_MALLOC"
+#endif
+
+#include <zlib.h>
+
+// Decompresses gzip or zlib data read from another loader
+typedef struct {
+  MicroConfLoader source;
+  MicroConfAllocator allocator;  // Memory of the zlib state
+  z_stream stream;
+  unsigned char input[MICRO_CONF_READ_SIZE];
+  bool member_end;  // A gzip member ended, another one may follow
+  bool done;
+} MicroConfGzip;
+
+// Initialize [gzip] to decompress what [source] reads
+MICRO_CONF_DEF int
+micro_conf_gzip_init(MicroConfGzip *gzip, MicroConfLoader source);
+
+// Initialize [gzip] to decompress what [source] reads, with the
+// memory of zlib from [allocator]
+MICRO_CONF_DEF int
+micro_conf_gzip_init_allocator(MicroConfGzip *gzip, MicroConfLoader source,
+                               MicroConfAllocator allocator);
+
+// Loader that reads the decompressed text of [gzip]
+MICRO_CONF_DEF MicroConfLoader
+micro_conf_gzip_loader(MicroConfGzip *gzip);
+
+// Release the memory of [gzip]
+MICRO_CONF_DEF void
+micro_conf_gzip_destroy(MicroConfGzip *gzip);
+
+#endif // MICRO_CONF_ZLIB
+
+// Build an [index] over the names of [conf], with memory from
+// [allocator]. If the same name is used more than once, the first
+// entry wins.
+MICRO_CONF_DEF int
+micro_conf_index_build(MicroConfIndex *index, MicroConfAllocator allocator,
+                       const MicroConf *conf, size_t num_conf);
+
+// Release the memory of [index]
+MICRO_CONF_DEF void
+micro_conf_index_destroy(MicroConfIndex *index);
+
+// The allocator using malloc, realloc and free. With
+// MICRO_CONF_NO_MALLOC, an allocator that always fails.
+MICRO_CONF_DEF MicroConfAllocator
+micro_conf_allocator_default(void);
+
+// Initialize [arena] over [size] bytes of [buffer]
+MICRO_CONF_DEF void
+micro_conf_arena_init(MicroConfArena *arena, void *buffer, size_t size);
+
+// Get an allocator that allocates from [arena]. Memory is released
+// only when the last allocation is freed, or with
+// `micro_conf_arena_reset`.
+MICRO_CONF_DEF MicroConfAllocator
+micro_conf_arena_allocator(MicroConfArena *arena);
+
+// Release all the allocations of [arena]
+MICRO_CONF_DEF void
+micro_conf_arena_reset(MicroConfArena *arena);
+
+// Find the entry named [key] of [key_len] bytes in [conf] using
+// [index], or a linear scan if the index is not built. Returns the
+// index of the entry, or (size_t)-1 if not found.
+MICRO_CONF_DEF size_t
+micro_conf_index_find(const MicroConfIndex *index, const MicroConf *conf,
+                      size_t num_conf, const char *key, size_t key_len);
+
+// Prepare the [num_conf] entries of [conf] in [prepared], using
+// [allocator]. [conf] must outlive [prepared].
+MICRO_CONF_DEF int
+micro_conf_prepare(MicroConfPrepared *prepared, MicroConfAllocator allocator,
+                   MicroConf *conf, size_t num_conf);
+
+// Release the memory of [prepared]
+MICRO_CONF_DEF void
+micro_conf_prepared_destroy(MicroConfPrepared *prepared);
+
+// Find the entry named [key] of [key_len] bytes in [prepared].
+// Returns the index of the entry, or (size_t)-1 if not found.
+MICRO_CONF_DEF size_t
+micro_conf_prepared_find(const MicroConfPrepared *prepared,
+                         const char *key, size_t key_len);
+
+// Make [parser] parse the entries of [prepared], instead of building
+// its own index. [prepared] can be shared by many parsers.
+MICRO_CONF_DEF void
+micro_conf_parser_use_prepared(MicroConfParser *parser,
+                               const MicroConfPrepared *prepared);
+
+// Compile the [num_patterns] [patterns] in [set], using [allocator].
+// [patterns] must outlive [set]. Fails with
+// MICRO_CONF_ERROR_INVALID_SCHEMA if a pattern does not have exactly
+// one `*`.
+MICRO_CONF_DEF int
+micro_conf_patterns_build(MicroConfPatternSet *set,
+                          MicroConfAllocator allocator,
+                          const MicroConfPattern *patterns,
+                          size_t num_patterns);
+
+// Release the memory of [set]
+MICRO_CONF_DEF void
+micro_conf_patterns_destroy(MicroConfPatternSet *set);
+
+// Find the first pattern of [set] matching [key] of [key_len] bytes.
+// Returns its index, or (size_t)-1 if none matches. If not NULL,
+// [match_offset] and [match_len] get the part matched by `*`.
+MICRO_CONF_DEF size_t
+micro_conf_patterns_match(const MicroConfPatternSet *set, const char *key,
+                          size_t key_len, size_t *match_offset,
+                          size_t *match_len);
+
+// Build in [plan] the copies that write the [defaults] of the
+// entries of [conf], with memory from [allocator]. [defaults] has
+// one value for each of the [num_conf] entries; if [has_default] is
+// not NULL, only the entries where it is true are written.
+//
+// Note: MICRO_CONF_STR defaults are not copied, the variables will
+// point to the strings of [defaults]
+MICRO_CONF_DEF int
+micro_conf_defaults_build(MicroConfDefaults *plan,
+                          MicroConfAllocator allocator,
+                          const MicroConf *conf,
+                          const MicroConfValue *defaults,
+                          const bool *has_default, size_t num_conf);
+
+// Write all the default values of [plan] to their variables
+MICRO_CONF_DEF void
+micro_conf_apply_defaults(const MicroConfDefaults *plan);
+
+// Release the memory of [plan]
+MICRO_CONF_DEF void
+micro_conf_defaults_destroy(MicroConfDefaults *plan);
+
+// Initialize [history] to keep up to [depth] snapshots of the
+// [num_conf] variables of [conf], with memory from [allocator]
+MICRO_CONF_DEF int
+micro_conf_history_init(MicroConfHistory *history,
+                        MicroConfAllocator allocator, MicroConf *conf,
+                        size_t num_conf, size_t depth);
+
+// Release all the snapshots of [history]
+MICRO_CONF_DEF void
+micro_conf_history_destroy(MicroConfHistory *history);
+
+// Save the current values of the variables as the latest snapshot,
+// dropping the oldest one if the ring is full. Strings equal to the
+// ones of the previous snapshot are shared.
+MICRO_CONF_DEF int
+micro_conf_history_push(MicroConfHistory *history);
+
+// Write back the snapshot [n] steps before the latest one, which
+// becomes the latest. Only the entries that changed since then are
+// written, assuming the variables still hold the latest snapshot; with
+// [n] 0 all the entries are written. MICRO_CONF_STR variables get
+// copies made with the allocator of [history], which the program owns
+// like the strings written by a parse. Fails with
+// MICRO_CONF_ERROR_OUT_OF_RANGE if there is no such snapshot, and
+// with MICRO_CONF_ERROR_OUT_OF_MEMORY if a copy fails, in which case
+// no variable is written.
+MICRO_CONF_DEF int
+micro_conf_rollback(MicroConfHistory *history, size_t n);
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+// Initialize [publisher] to publish the [num_conf] variables of
+// [conf], with memory from [allocator]. Nothing is published yet.
+MICRO_CONF_DEF int
+micro_conf_publisher_init(MicroConfPublisher *publisher,
+                          MicroConfAllocator allocator,
+                          const MicroConf *conf, size_t num_conf);
+
+// Drop the values of [publisher]. All its readers must be released
+// first.
+MICRO_CONF_DEF void
+micro_conf_publisher_destroy(MicroConfPublisher *publisher);
+
+// Copy the current values of the variables and make them visible to
+// the readers. Only one thread should publish at a time.
+MICRO_CONF_DEF int
+micro_conf_publish(MicroConfPublisher *publisher);
+
+// Initialize [reader] to read the values of [publisher]
+MICRO_CONF_DEF void
+micro_conf_reader_init(MicroConfReader *reader,
+                       MicroConfPublisher *publisher);
+
+// The latest published values, indexed like the entries of the
+// publisher, or NULL if nothing was published. They stay valid until
+// the next call on [reader]. If nothing was published since the last
+// call, this is a single load and compare.
+MICRO_CONF_DEF const MicroConfValue*
+micro_conf_reader_get(MicroConfReader *reader);
+
+// Drop the values held by [reader]
+MICRO_CONF_DEF void
+micro_conf_reader_release(MicroConfReader *reader);
+
+// Start reading the variables guarded by [seqlock], waiting while a
+// parse writes them. Returns the sequence to pass to
+// `micro_conf_seqlock_read_retry`.
+MICRO_CONF_DEF uint32_t
+micro_conf_seqlock_read_begin(const MicroConfSeqlock *seqlock);
+
+// Whether the variables were written since [sequence] was read, in
+// which case the values read may be inconsistent and must be read
+// again
+MICRO_CONF_DEF bool
+micro_conf_seqlock_read_retry(const MicroConfSeqlock *seqlock,
+                              uint32_t sequence);
+#endif // MICRO_CONF_HAS_ATOMICS
+
+// Write to [entries] the index of up to [max_entries] required
+// entries that were missing from the input of the last parse.
+// Returns the number of missing entries, which can be larger than
+// [max_entries].
+MICRO_CONF_DEF size_t
+micro_conf_parser_missing(const MicroConfParser *parser, size_t *entries,
+                          size_t max_entries);
+
+// Returns true if the entry [entry] was set by the input of the
+// last parse of [parser], false if it kept its default
+MICRO_CONF_DEF bool
+micro_conf_parser_from_file(const MicroConfParser *parser, size_t entry);
+
+// Get where the entry [entry] was last set, or NULL if provenance
+// is not tracked or the entry was never set
+MICRO_CONF_DEF const MicroConfProvenance*
+micro_conf_parser_provenance(const MicroConfParser *parser, size_t entry);
+
+// Get in [value] the value of [lazy], converting its text the first
+// time. Returns the error of the conversion, in which case [value]
+// gets the default. MICRO_CONF_STR values point to the text of
+// [lazy], valid until the next parse.
+MICRO_CONF_DEF int
+micro_conf_lazy_get(MicroConfLazy *lazy, MicroConfValue *value);
+
+// Release the text of [lazy]
+MICRO_CONF_DEF void
+micro_conf_lazy_destroy(MicroConfLazy *lazy);
+
+// Get the value of [key] of [key_len] bytes in [map], or NULL if the
+// map does not have it
+MICRO_CONF_DEF const MicroConfValue*
+micro_conf_map_get(const MicroConfMap *map, const char *key,
+                   size_t key_len);
+
+// Release all the keys of [map], which keeps its type and can be
+// filled again
+MICRO_CONF_DEF void
+micro_conf_map_destroy(MicroConfMap *map);
+
+// Sort the [num_conf] entries of [conf] by name, for
+// MICRO_CONF_FLAG_SORTED. This changes the index of the entries, so
+// sort before the first parse: parsers that already parsed [conf]
+// must be destroyed and initialized again, and a MicroConfPrepared
+// prepared again.
+MICRO_CONF_DEF void
+micro_conf_sort(MicroConf *conf, size_t num_conf);
+
+// Compile [syntax] in [table], for MicroConfParser.syntax. Fails with
+// MICRO_CONF_ERROR_INVALID_SCHEMA if a character has more than one
+// role, if a character is a new line, if a comment marker is longer
+// than two bytes, or if two markers of two bytes start the same way.
+MICRO_CONF_DEF int
+micro_conf_syntax_compile(MicroConfSyntaxTable *table,
+                          const MicroConfSyntax *syntax);
+
+// Initialize [digest] for SHA-256
+MICRO_CONF_DEF void
+micro_conf_digest_init(MicroConfDigest *digest);
+
+// Initialize [digest] for HMAC-SHA-256 with [key] of [key_len] bytes
+MICRO_CONF_DEF void
+micro_conf_digest_init_hmac(MicroConfDigest *digest, const void *key,
+                            size_t key_len);
+
+// Hash [size] bytes of [data]
+MICRO_CONF_DEF void
+micro_conf_digest_update(MicroConfDigest *digest, const void *data,
+                         size_t size);
+
+// Write the MICRO_CONF_DIGEST_SIZE bytes of the digest to [out]
+MICRO_CONF_DEF void
+micro_conf_digest_final(MicroConfDigest *digest, unsigned char *out);
+
+// Get the name of [type] as used in schema files, or NULL
+MICRO_CONF_DEF const char*
+micro_conf_type_name(MicroConfType type);
+
+// Get the MicroConfType named [name] of [len] bytes. Returns false if
+// there is no such type.
+MICRO_CONF_DEF bool
+micro_conf_type_from_name(const char *name, size_t len, MicroConfType *type);
+
+// Find [str] of [len] bytes in the [num_keywords] strings of
+// [keywords], ignoring case. Returns the index of the keyword, or
+// (size_t)-1 if not found.
+MICRO_CONF_DEF size_t
+micro_conf_keyword_find(const char *const *keywords, size_t num_keywords,
+                        const char *str, size_t len);
+
+// Get a human readable description of [error]
+MICRO_CONF_DEF const char*
+micro_conf_error_string(int error);
+
+// Initialize an empty [schema] using [allocator]
+MICRO_CONF_DEF void
+micro_conf_schema_init(MicroConfSchema *schema, MicroConfAllocator allocator);
+
+// Release all the memory owned by [schema]
+MICRO_CONF_DEF void
+micro_conf_schema_destroy(MicroConfSchema *schema);
+
+// Load into [schema] the entries described by [size] bytes of
+// [buffer], replacing the previous ones. Each line of a schema has
+// the same syntax as a config file, with the name of the type as
+// value, followed by optional attributes:
+//
+//    an_integer = int default=10 min=0 max=100
+//    a_str      = str default="a string" max=64 required
+//
+// min and max limit numbers, or the length of strings, and required
+// adds MICRO_CONF_REQUIRED to the type. Comments start at a `#` out
+// of quotes. On error, schema->diag tells where the error happened.
+MICRO_CONF_DEF int
+micro_conf_schema_parse(MicroConfSchema *schema, const char *buffer,
+                        size_t size);
+
+// Check that [value] of the entry [entry] respects the range of the
+// MicroConfSchema [schema]. This is a MicroConfValidateFn.
+MICRO_CONF_DEF int
+micro_conf_schema_validate(void *schema, size_t entry,
+                           const MicroConfValue *value, size_t len);
+
+// Let [parser] parse the entries of [schema], sharing its index and
+// checking the ranges of the values. The schema must outlive the
+// parses.
+MICRO_CONF_DEF void
+micro_conf_parser_use_schema(MicroConfParser *parser,
+                             MicroConfSchema *schema);
+
+#ifndef MICRO_CONF_NO_MALLOC
+
+// Same as `micro_conf_schema_parse`, reading the schema from
+// [pathname]
+MICRO_CONF_DEF int
+micro_conf_schema_load(MicroConfSchema *schema, const char *pathname);
+
+// Load and parse the [num_jobs] files of [jobs]. With io_uring, up to
+// MICRO_CONF_LOAD_DEPTH files are opened and read at the same time
+// and each one is fed to its own parser as its reads complete. All
+// the memory comes from [allocator]. Returns MICRO_CONF_OK if all the
+// files were parsed, or the first error otherwise; the result of
+// each file is in jobs[i].error and jobs[i].diag.
+MICRO_CONF_DEF int
+micro_conf_load_many(MicroConfLoadJob *jobs, size_t num_jobs,
+                     MicroConfAllocator allocator);
+
+#endif // MICRO_CONF_NO_MALLOC
+  
+//
+// Implementation
+//
+  
+#ifdef MICRO_CONF_IMPLEMENTATION
+
+#define _POSIX_C_SOURCE 200809L
+#ifndef MICRO_CONF_NO_MALLOC
+  #include <stdio.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+  #define _MICRO_CONF_SSE2
+  #include <emmintrin.h>
+#endif
+
+#if !defined(MICRO_CONF_NO_MALLOC) && (defined(__unix__) || defined(__APPLE__))
+  #define _MICRO_CONF_POSIX_IO
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#if defined(MICRO_CONF_IO_URING) && defined(_MICRO_CONF_POSIX_IO) \
+    && defined(__linux__) && defined(MICRO_CONF_HAS_ATOMICS)
+  #define _MICRO_CONF_HAS_IO_URING
+  #include <linux/io_uring.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #ifndef AT_FDCWD
+    #define AT_FDCWD -100
+  #endif
+  // Not declared in strict C99 mode
+  extern long syscall(long number, ...);
+#endif
+
+#define _MICRO_CONF_NOT_FOUND ((size_t)-1)
+
+#define _MICRO_CONF_BOM "\xEF\xBB\xBF"
+
+#ifdef MICRO_CONF_NO_MALLOC
+
+static void* _micro_conf_malloc(void *user, size_t size)
+{
+  (void) user;
+  (void) size;
+  return NULL;
+}
+
+static void* _micro_conf_realloc(void *user, void *ptr, size_t old_size,
+                                 size_t new_size)
+{
+  (void) user;
+  (void) ptr;
+  (void) old_size;
+  (void) new_size;
+  return NULL;
+}
+
+static void _micro_conf_free(void *user, void *ptr, size_t size)
+{
+  (void) user;
+  (void) ptr;
+  (void) size;
+}
+
+#else
+
+static void* _micro_conf_malloc(void *user, size_t size)
+{
+  (void) user;
+  return malloc(size);
+}
+
+static void* _micro_conf_realloc(void *user, void *ptr, size_t old_size,
+                                 size_t new_size)
+{
+  (void) user;
+  (void) old_size;
+  return realloc(ptr, new_size);
+}
+
+static void _micro_conf_free(void *user, void *ptr, size_t size)
+{
+  (void) user;
+  (void) size;
+  free(ptr);
+}
+
+#endif // MICRO_CONF_NO_MALLOC
+
+MICRO_CONF_DEF MicroConfAllocator
+micro_conf_allocator_default(void)
+{
+  MicroConfAllocator allocator;
+  allocator.alloc   = _micro_conf_malloc;
+  allocator.realloc = _micro_conf_realloc;
+  allocator.free    = _micro_conf_free;
+  allocator.user    = NULL;
+  return allocator;
+}
+
+MICRO_CONF_DEF void
+micro_conf_arena_init(MicroConfArena *arena, void *buffer, size_t size)
+{
+  if (!arena) return;
+  arena->buffer = (unsigned char*)buffer;
+  arena->size = buffer ? size : 0;
+  arena->used = 0;
+  arena->last = 0;
+}
+
+MICRO_CONF_DEF void
+micro_conf_arena_reset(MicroConfArena *arena)
+{
+  if (!arena) return;
+  arena->used = 0;
+  arena->last = 0;
+}
+
+static void* _micro_conf_arena_alloc(void *user, size_t size)
+{
+  MicroConfArena *arena = (MicroConfArena*)user;
+  size_t start = (arena->used + MICRO_CONF_ARENA_ALIGN - 1)
+    & ~((size_t)MICRO_CONF_ARENA_ALIGN - 1);
+  if (start < arena->used || start > arena->size ||
+      size > arena->size - start)
+    return NULL;
+  arena->last = start;
+  arena->used = start + size;
+  return arena->buffer + start;
+}
+
+static void* _micro_conf_arena_realloc(void *user, void *ptr,
+                                       size_t old_size, size_t new_size)
+{
+  MicroConfArena *arena = (MicroConfArena*)user;
+  if (!ptr) return _micro_conf_arena_alloc(user, new_size);
+
+  size_t offset = (size_t)((unsigned char*)ptr - arena->buffer);
+  if (offset == arena->last)
+  {
+    // Grow or shrink the last allocation in place
+    if (new_size > arena->size - offset) return NULL;
+    arena->used = offset + new_size;
+    return ptr;
+  }
+
+  void *new_ptr = _micro_conf_arena_alloc(user, new_size);
+  if (!new_ptr) return NULL;
+  memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  return new_ptr;
+}
+
+static void _micro_conf_arena_free(void *user, void *ptr, size_t size)
+{
+  MicroConfArena *arena = (MicroConfArena*)user;
+  (void) size;
+  if (ptr && (size_t)((unsigned char*)ptr - arena->buffer) == arena->last)
+    arena->used = arena->last;
+}
+
+MICRO_CONF_DEF MicroConfAllocator
+micro_conf_arena_allocator(MicroConfArena *arena)
+{
+  MicroConfAllocator allocator;
+  allocator.alloc   = _micro_conf_arena_alloc;
+  allocator.realloc = _micro_conf_arena_realloc;
+  allocator.free    = _micro_conf_arena_free;
+  allocator.user    = arena;
+  return allocator;
+}
+
+static void _micro_conf_release(const MicroConfAllocator *allocator,
+                                void *ptr, size_t size)
+{
+  if (ptr && allocator->free) allocator->free(allocator->user, ptr, size);
+}
+
+// Character classes of the default syntax: spaces and tabs, "=" and
+// ":" between keys and values, and "#" comments anywhere in a line.
+// Every scanner uses these classes, the digits are the same in all
+// the syntaxes.
+static const MicroConfSyntaxTable _micro_conf_syntax_default = {
+  {
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,  // 0x00
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x10
+   1,  8,  8,  4,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x20
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24,  2,  8,  8,  2,  8,  8,  // 0x30
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x40
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x50
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x60
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  0,  // 0x70
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x80
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0x90
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xa0
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xb0
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xc0
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xd0
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xe0
+   8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  // 0xf0
+  },
+  {0},
+  '#',
+  true,
+};
+
+// FNV-1a hash of [len] bytes of [str]
+static uint32_t _micro_conf_hash(const char *str, size_t len)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
+  {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool _micro_conf_name_eq(const char *name, const char *key,
+                                size_t key_len)
+{
+  return strncmp(name, key, key_len) == 0 && name[key_len] == '\0';
+}
+
+// Compare the NUL-terminated [name] with [key] of [key_len] bytes,
+// in the order of strcmp
+static int _micro_conf_name_cmp(const char *name, const char *key,
+                                size_t key_len)
+{
+  int cmp = strncmp(name, key, key_len);
+  if (cmp != 0) return cmp;
+  return name[key_len] != '\0';
+}
+
+MICRO_CONF_DEF int
+micro_conf_index_build(MicroConfIndex *index, MicroConfAllocator allocator,
+                       const MicroConf *conf, size_t num_conf)
+{
+  if (!index) return MICRO_CONF_ERROR_CONF_NULL;
+  index->allocator = allocator;
+  index->slots = NULL;
+  index->capacity = 0;
+  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+  if (num_conf >= UINT32_MAX / 2) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  size_t capacity = 8;
+  while (capacity < num_conf * 2) capacity *= 2;
+
+  MicroConfSlot *slots = (MicroConfSlot*)
+    allocator.alloc(allocator.user, capacity * sizeof(MicroConfSlot));
+  if (!slots) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  memset(slots, 0, capacity * sizeof(MicroConfSlot));
+
+  size_t mask = capacity - 1;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    size_t len = strlen(conf[i].name);
+    uint32_t hash = _micro_conf_hash(conf[i].name, len);
+    size_t pos = hash & mask;
+    while (slots[pos].entry != 0)
+    {
+      if (slots[pos].hash == hash &&
+          _micro_conf_name_eq(conf[slots[pos].entry - 1].name,
+                              conf[i].name, len))
+        break;
+      pos = (pos + 1) & mask;
+    }
+    if (slots[pos].entry != 0) continue;
+    slots[pos].hash = hash;
+    slots[pos].entry = (uint32_t)(i + 1);
+  }
+
+  index->slots = slots;
+  index->capacity = capacity;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_index_destroy(MicroConfIndex *index)
+{
+  if (!index) return;
+  if (index->capacity > 0)
+    _micro_conf_release(&index->allocator, index->slots,
+                        index->capacity * sizeof(MicroConfSlot));
+  index->slots = NULL;
+  index->capacity = 0;
+}
+
+// Find [key] of [key_len] bytes, with [hash], in the built [index]
+static size_t _micro_conf_index_probe(const MicroConfIndex *index,
+                                      const MicroConf *conf,
+                                      const char *key, size_t key_len,
+                                      uint32_t hash)
+{
+  size_t mask = index->capacity - 1;
+  size_t pos = hash & mask;
+  while (index->slots[pos].entry != 0)
+  {
+    if (index->slots[pos].hash == hash)
+    {
+      size_t entry = index->slots[pos].entry - 1;
+      if (_micro_conf_name_eq(conf[entry].name, key, key_len))
+        return entry;
+    }
+    pos = (pos + 1) & mask;
+  }
+  return _MICRO_CONF_NOT_FOUND;
+}
+
+MICRO_CONF_DEF size_t
+micro_conf_index_find(const MicroConfIndex *index, const MicroConf *conf,
+                      size_t num_conf, const char *key, size_t key_len)
+{
+  if (!index || index->capacity == 0)
+  {
+    for (size_t i = 0; i < num_conf; ++i)
+      if (_micro_conf_name_eq(conf[i].name, key, key_len))
+        return i;
+    return _MICRO_CONF_NOT_FOUND;
+  }
+  return _micro_conf_index_probe(index, conf, key, key_len,
+                                 _micro_conf_hash(key, key_len));
+}
+
+MICRO_CONF_DEF int
+micro_conf_prepare(MicroConfPrepared *prepared, MicroConfAllocator allocator,
+                   MicroConf *conf, size_t num_conf)
+{
+  if (!prepared) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(prepared, 0, sizeof(*prepared));
+  prepared->allocator = allocator;
+  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+  if (num_conf >= UINT32_MAX / 2) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  size_t pool_size = 0;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    pool_size += strlen(conf[i].name) + 1;
+    if (pool_size >= UINT32_MAX) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  }
+  size_t capacity = 8;
+  while (capacity < num_conf * 2) capacity *= 2;
+
+  // Arrays from the largest alignment to the smallest
+  size_t size = num_conf * sizeof(void*)
+    + capacity * sizeof(MicroConfPreparedSlot)
+    + num_conf * (sizeof(uint32_t) + sizeof(MicroConfType))
+    + pool_size;
+  char *memory = (char*)allocator.alloc(allocator.user, size);
+  if (!memory) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  void **targets = (void**)memory;
+  MicroConfPreparedSlot *slots =
+    (MicroConfPreparedSlot*)(targets + num_conf);
+  uint32_t *name_offsets = (uint32_t*)(slots + capacity);
+  MicroConfType *types = (MicroConfType*)(name_offsets + num_conf);
+  char *names = (char*)(types + num_conf);
+  memset(slots, 0, capacity * sizeof(MicroConfPreparedSlot));
+
+  size_t mask = capacity - 1;
+  uint32_t offset = 0;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    size_t len = strlen(conf[i].name);
+    memcpy(names + offset, conf[i].name, len + 1);
+    name_offsets[i] = offset;
+    types[i] = conf[i].type;
+    targets[i] = conf[i].value;
+
+    uint32_t hash = _micro_conf_hash(conf[i].name, len);
+    size_t pos = hash & mask;
+    while (slots[pos].entry != 0)
+    {
+      if (slots[pos].hash == hash && slots[pos].length == len &&
+          memcmp(names + slots[pos].name_offset, conf[i].name, len) == 0)
+        break;
+      pos = (pos + 1) & mask;
+    }
+    if (slots[pos].entry == 0)
+    {
+      slots[pos].hash = hash;
+      slots[pos].length = (uint32_t)len;
+      slots[pos].name_offset = offset;
+      slots[pos].entry = (uint32_t)(i + 1);
+    }
+    offset += (uint32_t)len + 1;
+  }
+
+  prepared->conf = conf;
+  prepared->num_conf = num_conf;
+  prepared->slots = slots;
+  prepared->capacity = capacity;
+  prepared->name_offsets = name_offsets;
+  prepared->names = names;
+  prepared->types = types;
+  prepared->targets = targets;
+  prepared->memory = memory;
+  prepared->memory_size = size;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_prepared_destroy(MicroConfPrepared *prepared)
+{
+  if (!prepared) return;
+  _micro_conf_release(&prepared->allocator, prepared->memory,
+                      prepared->memory_size);
+  MicroConfAllocator allocator = prepared->allocator;
+  memset(prepared, 0, sizeof(*prepared));
+  prepared->allocator = allocator;
+}
+
+// Probe the slots of [prepared] for [key] of [key_len] bytes, with
+// its [hash]
+static size_t _micro_conf_prepared_probe(const MicroConfPrepared *prepared,
+                                         const char *key, size_t key_len,
+                                         uint32_t hash)
+{
+  size_t mask = prepared->capacity - 1;
+  size_t pos = hash & mask;
+  const MicroConfPreparedSlot *slot;
+  while ((slot = &prepared->slots[pos])->entry != 0)
+  {
+    if (slot->hash == hash && slot->length == key_len &&
+        memcmp(prepared->names + slot->name_offset, key, key_len) == 0)
+      return slot->entry - 1;
+    pos = (pos + 1) & mask;
+  }
+  return _MICRO_CONF_NOT_FOUND;
+}
+
+MICRO_CONF_DEF size_t
+micro_conf_prepared_find(const MicroConfPrepared *prepared,
+                         const char *key, size_t key_len)
+{
+  if (!prepared || prepared->capacity == 0) return _MICRO_CONF_NOT_FOUND;
+  return _micro_conf_prepared_probe(prepared, key, key_len,
+                                    _micro_conf_hash(key, key_len));
+}
+
+MICRO_CONF_DEF void
+micro_conf_parser_use_prepared(MicroConfParser *parser,
+                               const MicroConfPrepared *prepared)
+{
+  if (!parser || !prepared) return;
+  micro_conf_index_destroy(&parser->index);
+  parser->conf = prepared->conf;
+  parser->num_conf = prepared->num_conf;
+  parser->shared_index = NULL;
+  parser->prepared = prepared;
+  parser->required_ready = false;
+}
+
+MICRO_CONF_DEF int
+micro_conf_patterns_build(MicroConfPatternSet *set,
+                          MicroConfAllocator allocator,
+                          const MicroConfPattern *patterns,
+                          size_t num_patterns)
+{
+  if (!set) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(set, 0, sizeof(*set));
+  set->allocator = allocator;
+  if (!patterns) return MICRO_CONF_ERROR_CONF_NULL;
+  if (num_patterns >= UINT32_MAX / 2) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  for (size_t i = 0; i < num_patterns; ++i)
+  {
+    const char *star = patterns[i].pattern
+      ? strchr(patterns[i].pattern, '*') : NULL;
+    if (!star || strchr(star + 1, '*'))
+      return MICRO_CONF_ERROR_INVALID_SCHEMA;
+  }
+
+  size_t capacity = 8;
+  while (capacity < num_patterns * 2) capacity *= 2;
+  size_t size = capacity * sizeof(MicroConfSlot)
+    + 3 * num_patterns * sizeof(uint32_t);
+  char *memory = (char*)allocator.alloc(allocator.user, size);
+  if (!memory) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  MicroConfSlot *slots = (MicroConfSlot*)memory;
+  uint32_t *prefix_len = (uint32_t*)(slots + capacity);
+  uint32_t *suffix_len = prefix_len + num_patterns;
+  uint32_t *lengths = suffix_len + num_patterns;
+  memset(slots, 0, capacity * sizeof(MicroConfSlot));
+
+  size_t mask = capacity - 1;
+  size_t num_lengths = 0;
+  for (size_t i = 0; i < num_patterns; ++i)
+  {
+    const char *pattern = patterns[i].pattern;
+    size_t prefix = (size_t)(strchr(pattern, '*') - pattern);
+    prefix_len[i] = (uint32_t)prefix;
+    suffix_len[i] = (uint32_t)strlen(pattern + prefix + 1);
+
+    uint32_t hash = _micro_conf_hash(pattern, prefix);
+    size_t pos = hash & mask;
+    while (slots[pos].entry != 0) pos = (pos + 1) & mask;
+    slots[pos].hash = hash;
+    slots[pos].entry = (uint32_t)(i + 1);
+
+    // Keep the distinct prefix lengths sorted
+    size_t l = num_lengths;
+    while (l > 0 && lengths[l - 1] > prefix_len[i]) l--;
+    if (l > 0 && lengths[l - 1] == prefix_len[i]) continue;
+    memmove(lengths + l + 1, lengths + l,
+            (num_lengths - l) * sizeof(uint32_t));
+    lengths[l] = prefix_len[i];
+    num_lengths++;
+  }
+
+  set->patterns = patterns;
+  set->num_patterns = num_patterns;
+  set->slots = slots;
+  set->capacity = capacity;
+  set->prefix_len = prefix_len;
+  set->suffix_len = suffix_len;
+  set->lengths = lengths;
+  set->num_lengths = num_lengths;
+  set->memory = memory;
+  set->memory_size = size;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_patterns_destroy(MicroConfPatternSet *set)
+{
+  if (!set) return;
+  _micro_conf_release(&set->allocator, set->memory, set->memory_size);
+  MicroConfAllocator allocator = set->allocator;
+  memset(set, 0, sizeof(*set));
+  set->allocator = allocator;
+}
+
+MICRO_CONF_DEF size_t
+micro_conf_patterns_match(const MicroConfPatternSet *set, const char *key,
+                          size_t key_len, size_t *match_offset,
+                          size_t *match_len)
+{
+  if (!set || set->capacity == 0) return _MICRO_CONF_NOT_FOUND;
+
+  size_t best = _MICRO_CONF_NOT_FOUND;
+  size_t mask = set->capacity - 1;
+  // Same hash as _micro_conf_hash, extended one prefix length at a time
+  uint32_t hash = 2166136261u;
+  size_t hashed = 0;
+  for (size_t l = 0; l < set->num_lengths; ++l)
+  {
+    size_t prefix = set->lengths[l];
+    if (prefix > key_len) break;
+    for (; hashed < prefix; ++hashed)
+    {
+      hash ^= (unsigned char)key[hashed];
+      hash *= 16777619u;
+    }
+
+    for (size_t pos = hash & mask; set->slots[pos].entry != 0;
+         pos = (pos + 1) & mask)
+    {
+      size_t p = set->slots[pos].entry - 1;
+      if (set->slots[pos].hash != hash || p >= best ||
+          set->prefix_len[p] != prefix)
+        continue;
+      size_t suffix = set->suffix_len[p];
+      const char *pattern = set->patterns[p].pattern;
+      if (key_len >= prefix + suffix &&
+          memcmp(pattern, key, prefix) == 0 &&
+          memcmp(pattern + prefix + 1, key + key_len - suffix, suffix) == 0)
+        best = p;
+    }
+  }
+
+  if (best != _MICRO_CONF_NOT_FOUND)
+  {
+    if (match_offset) *match_offset = set->prefix_len[best];
+    if (match_len)
+      *match_len = key_len - set->prefix_len[best] - set->suffix_len[best];
+  }
+  return best;
+}
+
+MICRO_CONF_DEF void
+micro_conf_parser_init_allocator(MicroConfParser *parser,
+                                 MicroConfAllocator allocator)
+{
+  if (!parser) return;
+  memset(parser, 0, sizeof(*parser));
+  parser->allocator = allocator;
+  parser->diag.entry = _MICRO_CONF_NOT_FOUND;
+#ifdef MICRO_CONF_NO_MALLOC
+  parser->line_cap = MICRO_CONF_LINE_MAX;
+#endif
+}
+
+MICRO_CONF_DEF void
+micro_conf_parser_init(MicroConfParser *parser)
+{
+  micro_conf_parser_init_allocator(parser, micro_conf_allocator_default());
+}
+
+MICRO_CONF_DEF void
+micro_conf_parser_destroy(MicroConfParser *parser)
+{
+  if (!parser) return;
+  micro_conf_index_destroy(&parser->index);
+#ifndef MICRO_CONF_NO_MALLOC
+  _micro_conf_release(&parser->allocator, parser->line, parser->line_cap);
+#endif
+  _micro_conf_release(&parser->allocator, parser->bits,
+                      parser->bits_cap * sizeof(uint64_t));
+  _micro_conf_release(&parser->allocator, parser->staged,
+                      parser->staged_cap * sizeof(MicroConfStaged));
+  _micro_conf_release(&parser->allocator, parser->stage_text,
+                      parser->stage_cap);
+  _micro_conf_release(&parser->allocator, parser->staged_values,
+                      parser->staged_values_cap
+                      * sizeof(MicroConfStagedValue));
+  _micro_conf_release(&parser->allocator, parser->order,
+                      2 * parser->order_len * sizeof(uint32_t));
+  _micro_conf_release(&parser->allocator, parser->filter,
+                      parser->filter_words * sizeof(uint64_t));
+  micro_conf_parser_init_allocator(parser, parser->allocator);
+}
+
+// Get the bitset of the entries resolved by the current parse
+static uint64_t* _micro_conf_resolved(const MicroConfParser *parser)
+{
+  if (parser->num_conf > MICRO_CONF_INLINE_ENTRIES) return parser->bits;
+  return (uint64_t*)parser->bits_inline;
+}
+
+// Get the bitset of the entries whose key is in the current parse
+static uint64_t* _micro_conf_seen(const MicroConfParser *parser)
+{
+  uint64_t *resolved = _micro_conf_resolved(parser);
+  return resolved ? resolved + MICRO_CONF_BITSET_WORDS(parser->num_conf)
+    : NULL;
+}
+
+// Get the bitset of the required entries
+static uint64_t* _micro_conf_required(const MicroConfParser *parser)
+{
+  uint64_t *resolved = _micro_conf_resolved(parser);
+  return resolved
+    ? resolved + 2 * MICRO_CONF_BITSET_WORDS(parser->num_conf) : NULL;
+}
+
+// Index of the lowest set bit of [word], which must not be 0
+static unsigned int _micro_conf_ctz64(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int)__builtin_ctzll(word);
+#else
+  unsigned int n = 0;
+  while (!(word & 1)) { word >>= 1; n++; }
+  return n;
+#endif
+}
+
+static int _micro_conf_fail_at(MicroConfParser *parser, int error,
+                               unsigned int line, unsigned int column,
+                               size_t entry)
+{
+  MicroConfDiagnostic diag;
+  diag.error = error;
+  diag.line = line;
+  diag.column = column;
+  diag.entry = entry;
+
+  parser->num_errors++;
+  if (parser->diag.error == MICRO_CONF_OK) parser->diag = diag;
+  if (parser->on_error)
+    parser->on_error(parser->on_error_user, &diag,
+                     parser->line_len > 0 ? parser->line : "");
+
+  // With MICRO_CONF_FLAG_KEEP_GOING only errors in a value or a key
+  // let the parse continue
+  bool recoverable = error == MICRO_CONF_ERROR_UNKNOWN_TYPE
+    || error == MICRO_CONF_ERROR_UNKNOWN_KEY
+    || error == MICRO_CONF_ERROR_OUT_OF_RANGE
+    || error == MICRO_CONF_ERROR_MISSING_KEY
+    || error == MICRO_CONF_ERROR_INVALID_UTF8
+    || (error <= MICRO_CONF_ERROR_INVALID_BOOL
+        && error >= MICRO_CONF_ERROR_INVALID_CHAR);
+  if (!(parser->flags & MICRO_CONF_FLAG_KEEP_GOING) || !recoverable)
+    parser->halted = true;
+  return error;
+}
+
+// Report [error] on the current line
+static int _micro_conf_fail(MicroConfParser *parser, int error,
+                            unsigned int column, size_t entry)
+{
+  return _micro_conf_fail_at(parser, error, parser->line_number, column,
+                             entry);
+}
+
+// Whether a comment marker of [syntax] starts at [p], before [end]
+static bool _micro_conf_comment_at(const MicroConfSyntaxTable *syntax,
+                                   const char *p, const char *end)
+{
+  unsigned char c = (unsigned char)*p;
+  if (!(syntax->classes[c] & MICRO_CONF_CLASS_COMMENT)) return false;
+  unsigned char next = syntax->comment_next[c];
+  return next == 0 || (p + 1 < end && (unsigned char)p[1] == next);
+}
+
+// Split the first [len] bytes of [line] in a key and a value, after
+// removing comments and surrounding spaces, in a single walk over
+// the character classes of [syntax]. Returns false if the line has
+// no key.
+static bool _micro_conf_split_line(const MicroConfSyntaxTable *syntax,
+                                   const char *line, size_t len,
+                                   const char **key, size_t *key_len,
+                                   const char **value, size_t *value_len)
+{
+  const unsigned char *classes = syntax->classes;
+  bool inline_comments = syntax->inline_comments;
+  if (len > 0 && line[len - 1] == '\r') len--;
+  const char *end = line + len;
+
+  const char *p = line;
+  while (p < end && (classes[(unsigned char)*p] & MICRO_CONF_CLASS_SPACE))
+    p++;
+  if (p == end || _micro_conf_comment_at(syntax, p, end)) return false;
+
+  const char *k = p;
+  for (; p < end; ++p)
+  {
+    unsigned char c = classes[(unsigned char)*p];
+    if (c & MICRO_CONF_CLASS_KEY) continue;
+    if (c & (MICRO_CONF_CLASS_SPACE | MICRO_CONF_CLASS_SEPARATOR)) break;
+    if ((c & MICRO_CONF_CLASS_COMMENT) && inline_comments &&
+        _micro_conf_comment_at(syntax, p, end))
+      break;
+  }
+  const char *k_end = p;
+
+  while (p < end && (classes[(unsigned char)*p] & MICRO_CONF_CLASS_SPACE))
+    p++;
+  if (p < end && (classes[(unsigned char)*p] & MICRO_CONF_CLASS_SEPARATOR))
+    p++;
+  while (p < end && (classes[(unsigned char)*p] & MICRO_CONF_CLASS_SPACE))
+    p++;
+
+  // The value ends at a comment, without trailing spaces
+  const char *v = p;
+  if (!inline_comments)
+    p = end;
+  else if (syntax->comment_start)
+  {
+    const char *c = p;
+    while ((c = (const char*)memchr(c, syntax->comment_start,
+                                    (size_t)(end - c))) &&
+           !_micro_conf_comment_at(syntax, c, end))
+      c++;
+    p = c ? c : end;
+  }
+  else
+    while (p < end && !((classes[(unsigned char)*p] & MICRO_CONF_CLASS_COMMENT)
+                        && _micro_conf_comment_at(syntax, p, end)))
+      p++;
+  const char *v_end = p;
+  while (v_end > v &&
+         (classes[(unsigned char)v_end[-1]] & MICRO_CONF_CLASS_SPACE))
+    v_end--;
+
+  *key = k;
+  *key_len = (size_t)(k_end - k);
+  *value = v;
+  *value_len = (size_t)(v_end - v);
+  return true;
+}
+
+// Load up to 8 bytes of [str] in a word, padded with zeros
+static uint64_t _micro_conf_word(const char *str, size_t len)
+{
+  uint64_t word = 0;
+  memcpy(&word, str, len);
+  return word;
+}
+
+// Whether the [len] bytes of [str] are valid UTF-8: no overlong
+// sequences, no surrogates and nothing above U+10FFFF
+static bool _micro_conf_utf8_valid(const char *str, size_t len)
+{
+  const unsigned char *s = (const unsigned char*)str;
+  size_t i = 0;
+  while (i < len)
+  {
+    // Skip ASCII a block at a time
+#ifdef _MICRO_CONF_SSE2
+    while (i + 16 <= len &&
+           _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) == 0)
+      i += 16;
+#endif
+    while (i + 8 <= len &&
+           (_micro_conf_word(str + i, 8) & 0x8080808080808080ull) == 0)
+      i += 8;
+    if (i == len) break;
+
+    unsigned char c = s[i];
+    if (c < 0x80)
+    {
+      i++;
+      continue;
+    }
+    size_t n;
+    uint32_t point, min;
+    if ((c & 0xe0) == 0xc0)      { n = 1; point = c & 0x1f; min = 0x80; }
+    else if ((c & 0xf0) == 0xe0) { n = 2; point = c & 0x0f; min = 0x800; }
+    else if ((c & 0xf8) == 0xf0) { n = 3; point = c & 0x07; min = 0x10000; }
+    else return false;
+    if (len - i <= n) return false;
+    for (size_t k = 1; k <= n; ++k)
+    {
+      if ((s[i + k] & 0xc0) != 0x80) return false;
+      point = point << 6 | (s[i + k] & 0x3f);
+    }
+    if (point < min || point > 0x10ffff ||
+        (point >= 0xd800 && point <= 0xdfff))
+      return false;
+    i += n + 1;
+  }
+  return true;
+}
+
+// Turn the ASCII upper case letters of [word] to lower case, all
+// bytes at once
+static uint64_t _micro_conf_word_lower(uint64_t word)
+{
+  const uint64_t ones = 0x0101010101010101ull;
+  const uint64_t high = ones * 0x80;
+  uint64_t low7 = word & ~high;
+  uint64_t ge_a = low7 + ones * (0x80 - 'A');
+  uint64_t gt_z = low7 + ones * (0x80 - 'Z' - 1);
+  uint64_t upper = ge_a & ~gt_z & ~word & high;
+  return word | (upper >> 2);
+}
+
+// Convert the NUL-terminated [str] of [len] bytes to a value of
+// [type]. MICRO_CONF_STR values point to [str].
+static int _micro_conf_convert(MicroConfType type, const char *str,
+                               size_t len, MicroConfValue *value)
+{
+  switch (type)
+  {
+  case MICRO_CONF_BOOL:
+  {
+    if (len == 0 || len > 5) return MICRO_CONF_ERROR_INVALID_BOOL;
+    uint64_t word = _micro_conf_word_lower(_micro_conf_word(str, len));
+    bool yes = (word == _micro_conf_word("true", 4))
+      | (word == _micro_conf_word("yes", 3))
+      | (word == _micro_conf_word("on", 2))
+      | (word == _micro_conf_word("1", 1));
+    bool no = (word == _micro_conf_word("false", 5))
+      | (word == _micro_conf_word("no", 2))
+      | (word == _micro_conf_word("off", 3))
+      | (word == _micro_conf_word("0", 1));
+    if (!(yes | no)) return MICRO_CONF_ERROR_INVALID_BOOL;
+    value->b = yes;
+    break;
+  }
+  case MICRO_CONF_CHAR:
+  {
+    if (len != 1) return MICRO_CONF_ERROR_INVALID_CHAR;
+    value->c = str[0];
+    break;
+  }
+  case MICRO_CONF_STR:
+  {
+    value->s = str;
+    break;
+  }
+  case MICRO_CONF_INT:
+  {
+    // Up to 18 digits cannot overflow the loop. Longer numbers, and
+    // anything else than digits, go through strtol. Both reject what
+    // does not fit in an int.
+    const unsigned char *classes = _micro_conf_syntax_default.classes;
+    size_t start = len > 0 && (str[0] == '-' || str[0] == '+');
+    size_t i = start;
+    int64_t parsed = 0;
+    if (len - start <= 18)
+      for (; i < len && (classes[(unsigned char)str[i]]
+                         & MICRO_CONF_CLASS_DIGIT); ++i)
+        parsed = parsed * 10 + (str[i] - '0');
+    if (i > start && i == len)
+    {
+      if (str[0] == '-') parsed = -parsed;
+      if (parsed < INT_MIN || parsed > INT_MAX)
+        return MICRO_CONF_ERROR_INVALID_INT;
+      value->i = (int)parsed;
+      break;
+    }
+    char *endptr;
+    errno = 0;
+    long val = strtol(str, &endptr, 10);
+    if (endptr == str || *endptr != '\0' || errno == ERANGE ||
+        val < INT_MIN || val > INT_MAX)
+      return MICRO_CONF_ERROR_INVALID_INT;
+    value->i = (int)val;
+    break;
+  }
+  case MICRO_CONF_DOUBLE:
+  {
+    char *endptr;
+    value->d = strtod(str, &endptr);
+    if (endptr == str || *endptr != '\0')
+      return MICRO_CONF_ERROR_INVALID_DOUBLE;
+    break;
+  }
+  case MICRO_CONF_FLOAT:
+  {
+    char *endptr;
+    value->f = strtof(str, &endptr);
+    if (endptr == str || *endptr != '\0')
+      return MICRO_CONF_ERROR_INVALID_FLOAT;
+    break;
+  }
+  default:
+    return MICRO_CONF_ERROR_UNKNOWN_TYPE;
+  }
+
+  return MICRO_CONF_OK;
+}
+
+// Write [value] to the variable of [conf]. MICRO_CONF_STR values of
+// [len] bytes are copied with the allocator of [parser].
+static int _micro_conf_store(MicroConfParser *parser, const MicroConf *conf,
+                             const MicroConfValue *value, size_t len)
+{
+  if (!conf->value) return MICRO_CONF_OK;
+
+  switch (MICRO_CONF_TYPE(conf->type))
+  {
+  case MICRO_CONF_BOOL:   *((bool*)conf->value) = value->b;   break;
+  case MICRO_CONF_INT:    *((int*)conf->value) = value->i;    break;
+  case MICRO_CONF_FLOAT:  *((float*)conf->value) = value->f;  break;
+  case MICRO_CONF_DOUBLE: *((double*)conf->value) = value->d; break;
+  case MICRO_CONF_CHAR:   *((char*)conf->value) = value->c;   break;
+  case MICRO_CONF_STR:
+  {
+    char *str = (char*)parser->allocator.alloc(parser->allocator.user,
+                                               len + 1);
+    if (!str) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    memcpy(str, value->s, len);
+    str[len] = '\0';
+    *((char**)conf->value) = str;
+    break;
+  }
+  default:
+    return MICRO_CONF_ERROR_UNKNOWN_TYPE;
+  }
+  return MICRO_CONF_OK;
+}
+
+// Copy the [len] bytes of [str] to the MicroConfLazy of [conf],
+// reusing its buffer if it is large enough
+static int _micro_conf_lazy_store(MicroConfParser *parser,
+                                  const MicroConf *conf,
+                                  const char *str, size_t len)
+{
+  MicroConfLazy *lazy = (MicroConfLazy*)conf->value;
+  if (!lazy) return MICRO_CONF_OK;
+
+  if (len + 1 > lazy->cap)
+  {
+    MicroConfAllocator allocator = lazy->cap > 0
+      ? lazy->allocator : parser->allocator;
+    char *text = (char*)allocator.realloc(allocator.user, lazy->text,
+                                          lazy->cap, len + 1);
+    if (!text) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    lazy->allocator = allocator;
+    lazy->text = text;
+    lazy->cap = len + 1;
+  }
+  memcpy(lazy->text, str, len);
+  lazy->text[len] = '\0';
+  lazy->len = len;
+  lazy->type = MICRO_CONF_TYPE(conf->type);
+  lazy->converted = false;
+  lazy->error = MICRO_CONF_OK;
+  return MICRO_CONF_OK;
+}
+
+// Whether the values of the current line must not be written
+static bool _micro_conf_dry_run(const MicroConfParser *parser)
+{
+  return (parser->flags & MICRO_CONF_FLAG_DRY_RUN) || parser->staging;
+}
+
+// Keep the first [len] bytes of [line], which parsed successfully, to
+// replay them once the digest is verified
+static int _micro_conf_stage_line(MicroConfParser *parser,
+                                  const char *line, size_t len)
+{
+  MicroConfAllocator *allocator = &parser->allocator;
+  if (parser->num_staged == parser->staged_cap)
+  {
+    size_t cap = parser->staged_cap ? parser->staged_cap * 2 : 32;
+    MicroConfStaged *staged = (MicroConfStaged*)allocator->realloc(
+      allocator->user, parser->staged,
+      parser->staged_cap * sizeof(MicroConfStaged),
+      cap * sizeof(MicroConfStaged));
+    if (!staged) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    parser->staged = staged;
+    parser->staged_cap = cap;
+  }
+  if (parser->stage_len + len + 1 > parser->stage_cap)
+  {
+    size_t cap = parser->stage_cap ? parser->stage_cap : 1024;
+    while (cap < parser->stage_len + len + 1) cap *= 2;
+    char *text = (char*)allocator->realloc(allocator->user,
+                                           parser->stage_text,
+                                           parser->stage_cap, cap);
+    if (!text) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    parser->stage_text = text;
+    parser->stage_cap = cap;
+  }
+
+  MicroConfStaged *staged = &parser->staged[parser->num_staged++];
+  staged->text = parser->stage_len;
+  staged->len = len;
+  staged->offset = parser->line_offset;
+  staged->line = parser->line_number;
+  memcpy(parser->stage_text + parser->stage_len, line, len);
+  parser->stage_text[parser->stage_len + len] = '\0';
+  parser->stage_len += len + 1;
+  return MICRO_CONF_OK;
+}
+
+// Keep the converted [value] of the scalar [conf], to write it in the
+// write section of the seqlock
+// Whether the values of [parser] are written inside a seqlock
+static bool _micro_conf_seqlocked(const MicroConfParser *parser)
+{
+#ifdef MICRO_CONF_HAS_ATOMICS
+  return parser->seqlock != NULL;
+#else
+  (void) parser;
+  return false;
+#endif
+}
+
+static int _micro_conf_stage_value(MicroConfParser *parser,
+                                   const MicroConf *conf,
+                                   const MicroConfValue *value)
+{
+  if (!conf->value) return MICRO_CONF_OK;
+  if (parser->num_staged_values == parser->staged_values_cap)
+  {
+    size_t cap = parser->staged_values_cap
+      ? parser->staged_values_cap * 2 : 32;
+    MicroConfStagedValue *values = (MicroConfStagedValue*)
+      parser->allocator.realloc(parser->allocator.user,
+                                parser->staged_values,
+                                parser->staged_values_cap
+                                * sizeof(MicroConfStagedValue),
+                                cap * sizeof(MicroConfStagedValue));
+    if (!values) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    parser->staged_values = values;
+    parser->staged_values_cap = cap;
+  }
+  MicroConfStagedValue *staged =
+    &parser->staged_values[parser->num_staged_values++];
+  staged->target = conf->value;
+  staged->type = MICRO_CONF_TYPE(conf->type);
+  staged->value = *value;
+  return MICRO_CONF_OK;
+}
+
+// Find [key] of [key_len] bytes in the adaptive order of [parser].
+// If [count], move the entry found ahead of the ones found less
+// often.
+static size_t _micro_conf_adaptive_find(MicroConfParser *parser,
+                                        const char *key, size_t key_len,
+                                        bool count)
+{
+  uint32_t *order = parser->order;
+  uint32_t *hits = parser->hits;
+  const MicroConf *conf = parser->conf;
+  for (size_t k = 0; k < parser->order_len; ++k)
+  {
+    uint32_t entry = order[k];
+    if (!_micro_conf_name_eq(conf[entry].name, key, key_len)) continue;
+    if (!count) return entry;
+
+    // Halve all the counts before they overflow, which also lets
+    // newer hits weigh more
+    if (hits[k] == UINT32_MAX)
+      for (size_t j = 0; j < parser->order_len; ++j)
+        hits[j] /= 2;
+    uint32_t count = hits[k] + 1;
+    size_t j = k;
+    for (; j > 0 && hits[j - 1] < count; --j)
+    {
+      order[j] = order[j - 1];
+      hits[j] = hits[j - 1];
+    }
+    order[j] = entry;
+    hits[j] = count;
+    return entry;
+  }
+  return _MICRO_CONF_NOT_FOUND;
+}
+
+// Find [key] of [key_len] bytes with the key index of [parser]
+static size_t _micro_conf_lookup(const MicroConfParser *parser,
+                                 const char *key, size_t key_len)
+{
+  if (parser->prepared)
+    return micro_conf_prepared_find(parser->prepared, key, key_len);
+  const MicroConfIndex *index = parser->shared_index
+    ? parser->shared_index : &parser->index;
+  return micro_conf_index_find(index, parser->conf, parser->num_conf,
+                               key, key_len);
+}
+
+// Same as `_micro_conf_lookup`, with the [hash] of the key
+static size_t _micro_conf_lookup_hashed(const MicroConfParser *parser,
+                                        const char *key, size_t key_len,
+                                        uint32_t hash)
+{
+  if (parser->prepared)
+    return parser->prepared->capacity == 0 ? _MICRO_CONF_NOT_FOUND
+      : _micro_conf_prepared_probe(parser->prepared, key, key_len, hash);
+  const MicroConfIndex *index = parser->shared_index
+    ? parser->shared_index : &parser->index;
+  if (index->capacity == 0)
+    return _micro_conf_lookup(parser, key, key_len);
+  return _micro_conf_index_probe(index, parser->conf, key, key_len, hash);
+}
+
+// The two bits of [hash] in a Bloom filter of [words] words
+#define _MICRO_CONF_FILTER_BITS(hash, words, a, b)              \
+  do {                                                         \
+    size_t _mask = (words) * 64 - 1;                           \
+    (a) = (hash) & _mask;                                      \
+    (b) = ((hash) >> 16 | (uint32_t)((hash) << 16)) & _mask;   \
+  } while (0)
+
+// Whether [hash] may be the hash of a name of [parser]
+static bool _micro_conf_filter_has(const MicroConfParser *parser,
+                                   uint32_t hash)
+{
+  if (parser->filter_words == 0) return true;
+  size_t a, b;
+  _MICRO_CONF_FILTER_BITS(hash, parser->filter_words, a, b);
+  return (parser->filter[a / 64] >> (a % 64))
+    & (parser->filter[b / 64] >> (b % 64)) & 1;
+}
+
+// Build the Bloom filter of [parser] over the names of its entries,
+// with about 8 bits per name. Without memory, no filter is used.
+static void _micro_conf_filter_build(MicroConfParser *parser)
+{
+  size_t words = 1;
+  while (words * 8 < parser->num_conf && words < ((size_t)1 << 26))
+    words *= 2;
+  if (words != parser->filter_words)
+  {
+    _micro_conf_release(&parser->allocator, parser->filter,
+                        parser->filter_words * sizeof(uint64_t));
+    parser->filter_words = 0;
+    parser->filter = (uint64_t*)parser->allocator.alloc(
+      parser->allocator.user, words * sizeof(uint64_t));
+    if (!parser->filter) return;
+    parser->filter_words = words;
+  }
+  memset(parser->filter, 0, words * sizeof(uint64_t));
+
+  for (size_t i = 0; i < parser->num_conf; ++i)
+  {
+    const char *name = parser->conf[i].name;
+    uint32_t hash = _micro_conf_hash(name, strlen(name));
+    size_t a, b;
+    _MICRO_CONF_FILTER_BITS(hash, words, a, b);
+    parser->filter[a / 64] |= (uint64_t)1 << (a % 64);
+    parser->filter[b / 64] |= (uint64_t)1 << (b % 64);
+  }
+}
+
+// Rehash the keys of [map] in a table of [capacity] slots
+static int _micro_conf_map_grow(MicroConfMap *map, size_t capacity)
+{
+  MicroConfMapSlot *slots = (MicroConfMapSlot*)map->allocator.alloc(
+    map->allocator.user, capacity * sizeof(MicroConfMapSlot));
+  if (!slots) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  memset(slots, 0, capacity * sizeof(MicroConfMapSlot));
+
+  size_t mask = capacity - 1;
+  for (size_t i = 0; i < map->capacity; ++i)
+  {
+    if (!map->slots[i].key) continue;
+    size_t pos = map->slots[i].hash & mask;
+    while (slots[pos].key) pos = (pos + 1) & mask;
+    slots[pos] = map->slots[i];
+  }
+  _micro_conf_release(&map->allocator, map->slots,
+                      map->capacity * sizeof(MicroConfMapSlot));
+  map->slots = slots;
+  map->capacity = capacity;
+  return MICRO_CONF_OK;
+}
+
+// Set [key] of [key_len] bytes of [map] to [value]. Keys, and
+// MICRO_CONF_STR values of [len] bytes, are copied with the allocator
+// of the map, which is [allocator] if the map is empty.
+static int _micro_conf_map_put(MicroConfMap *map,
+                               const MicroConfAllocator *allocator,
+                               const char *key, size_t key_len,
+                               const MicroConfValue *value, size_t len)
+{
+  if (map->capacity == 0) map->allocator = *allocator;
+  if (key_len >= UINT32_MAX) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  if ((map->count + 1) * 4 > map->capacity * 3)
+  {
+    int err = _micro_conf_map_grow(map, map->capacity
+                                   ? map->capacity * 2 : 16);
+    if (err != MICRO_CONF_OK) return err;
+  }
+
+  uint32_t hash = _micro_conf_hash(key, key_len);
+  size_t mask = map->capacity - 1;
+  size_t pos = hash & mask;
+  while (map->slots[pos].key &&
+         !(map->slots[pos].hash == hash &&
+           map->slots[pos].key_len == key_len &&
+           memcmp(map->slots[pos].key, key, key_len) == 0))
+    pos = (pos + 1) & mask;
+  MicroConfMapSlot *slot = &map->slots[pos];
+
+  MicroConfValue stored = *value;
+  if (map->type == MICRO_CONF_STR)
+  {
+    char *str = (char*)map->allocator.alloc(map->allocator.user, len + 1);
+    if (!str) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    memcpy(str, value->s, len);
+    str[len] = '\0';
+    stored.s = str;
+  }
+
+  if (slot->key)
+  {
+    if (map->type == MICRO_CONF_STR)
+      _micro_conf_release(&map->allocator, (void*)slot->value.s,
+                          strlen(slot->value.s) + 1);
+  }
+  else
+  {
+    char *copy = (char*)map->allocator.alloc(map->allocator.user,
+                                             key_len + 1);
+    if (!copy)
+    {
+      if (map->type == MICRO_CONF_STR)
+        _micro_conf_release(&map->allocator, (void*)stored.s, len + 1);
+      return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(copy, key, key_len);
+    copy[key_len] = '\0';
+    slot->key = copy;
+    slot->key_len = (uint32_t)key_len;
+    slot->hash = hash;
+    map->count++;
+  }
+  slot->value = stored;
+  return MICRO_CONF_OK;
+}
+
+// Find the MICRO_CONF_MAP entry whose name, followed by a dot, starts
+// [key] of [key_len] bytes. [sub_key] gets the offset of the rest of
+// the key.
+static size_t _micro_conf_find_map(const MicroConfParser *parser,
+                                   const char *key, size_t key_len,
+                                   size_t *sub_key)
+{
+  for (size_t n = 0; n + 1 < key_len; ++n)
+  {
+    if (key[n] != '.') continue;
+    size_t i = _micro_conf_lookup(parser, key, n);
+    if (i != _MICRO_CONF_NOT_FOUND &&
+        MICRO_CONF_TYPE(parser->conf[i].type) == MICRO_CONF_MAP)
+    {
+      *sub_key = n + 1;
+      return i;
+    }
+  }
+  return _MICRO_CONF_NOT_FOUND;
+}
+
+// Convert the value of [key] of [key_len] bytes for the
+// MICRO_CONF_MAP entry [conf], and store it in its map
+static int _micro_conf_map_value(MicroConfParser *parser,
+                                 const MicroConf *conf, size_t entry,
+                                 const char *key, size_t key_len,
+                                 const char *value_str, size_t value_len)
+{
+  MicroConfMap *map = (MicroConfMap*)conf->value;
+  if (!map) return MICRO_CONF_OK;
+
+  MicroConfValue value;
+  int err = _micro_conf_convert(MICRO_CONF_TYPE(map->type), value_str,
+                                value_len, &value);
+  if (err == MICRO_CONF_OK && parser->validate)
+    err = parser->validate(parser->validate_user, entry, &value, value_len);
+  if (err != MICRO_CONF_OK || _micro_conf_dry_run(parser))
+    return err;
+  return _micro_conf_map_put(map, &parser->allocator, key, key_len,
+                             &value, value_len);
+}
+
+// Find [key] of [key_len] bytes moving forward in the sorted entries
+// of [parser]. If [key] sorts before an entry already passed, the
+// input is not in order: build the index and use it from now on.
+static size_t _micro_conf_merge_find(MicroConfParser *parser,
+                                     const char *key, size_t key_len)
+{
+  const MicroConf *conf = parser->conf;
+  size_t c = parser->cursor;
+  int cmp = 1;
+  while (c < parser->num_conf &&
+         (cmp = _micro_conf_name_cmp(conf[c].name, key, key_len)) < 0)
+    c++;
+
+  if (c == parser->cursor && cmp != 0 && c > 0 &&
+      _micro_conf_name_cmp(conf[c - 1].name, key, key_len) >= 0)
+  {
+    parser->in_order = false;
+    if (!parser->shared_index && !parser->prepared && !parser->index.slots)
+      (void) micro_conf_index_build(&parser->index, parser->allocator,
+                                    conf, parser->num_conf);
+    return _micro_conf_lookup(parser, key, key_len);
+  }
+
+  parser->cursor = c;
+  return cmp == 0 ? c : _MICRO_CONF_NOT_FOUND;
+}
+
+// Whether the values of [conf] are strings, directly or in a map
+static bool _micro_conf_holds_text(const MicroConf *conf)
+{
+  MicroConfType type = MICRO_CONF_TYPE(conf->type);
+  if (type == MICRO_CONF_MAP)
+    return conf->value && ((const MicroConfMap*)conf->value)->type
+      == MICRO_CONF_STR;
+  return type == MICRO_CONF_STR;
+}
+
+// Convert the value of [key], matched by the pattern [p], and pass it
+// to the callback of the pattern
+static int _micro_conf_parse_pattern(MicroConfParser *parser,
+                                     char *line, size_t p,
+                                     const char *key, size_t key_len,
+                                     size_t match_offset, size_t match_len,
+                                     const char *value_str,
+                                     size_t value_len)
+{
+  const MicroConfPattern *pattern = &parser->patterns->patterns[p];
+  line[(value_str - line) + value_len] = '\0';
+  unsigned int column = (unsigned int)(value_str - line) + 1;
+
+  if ((parser->flags & MICRO_CONF_FLAG_UTF8) &&
+      MICRO_CONF_TYPE(pattern->type) == MICRO_CONF_STR &&
+      !_micro_conf_utf8_valid(value_str, value_len))
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_INVALID_UTF8, column,
+                            _MICRO_CONF_NOT_FOUND);
+
+  MicroConfValue value;
+  int err = _micro_conf_convert(MICRO_CONF_TYPE(pattern->type), value_str,
+                                value_len, &value);
+  if (err == MICRO_CONF_OK && pattern->callback &&
+      !_micro_conf_dry_run(parser))
+    err = pattern->callback(pattern->user, key, key_len,
+                            key + match_offset, match_len,
+                            &value, value_len);
+  if (err == MICRO_CONF_OK && parser->staging)
+    err = _micro_conf_stage_line(parser, line,
+                                 (size_t)(value_str - line) + value_len);
+  if (err != MICRO_CONF_OK)
+    return _micro_conf_fail(parser, err, column, _MICRO_CONF_NOT_FOUND);
+  return MICRO_CONF_OK;
+}
+
+// Parse a single NUL-terminated [line] of [len] bytes, without the
+// trailing new line. The line is modified in place.
+static int _micro_conf_parse_line(MicroConfParser *parser, char *line,
+                                  size_t len)
+{
+  // Drop the BOM from the line itself, so that the columns match
+  // the line passed to `on_error`
+  if (parser->line_offset == 0 && len >= 3 &&
+      memcmp(line, _MICRO_CONF_BOM, 3) == 0)
+  {
+    memmove(line, line + 3, len - 2);
+    len -= 3;
+    if (line == parser->line) parser->line_len = len;
+    parser->line_offset = 3;
+  }
+
+  const char *key, *value_str;
+  size_t key_len, value_len;
+  const MicroConfSyntaxTable *syntax = parser->syntax
+    ? parser->syntax : &_micro_conf_syntax_default;
+  if (!_micro_conf_split_line(syntax, line, len, &key, &key_len,
+                              &value_str, &value_len))
+    return MICRO_CONF_OK;
+  bool utf8 = parser->flags & MICRO_CONF_FLAG_UTF8;
+  if (utf8 && !_micro_conf_utf8_valid(key, key_len))
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_INVALID_UTF8,
+                            (unsigned int)(key - line) + 1,
+                            _MICRO_CONF_NOT_FOUND);
+
+  size_t i;
+  if ((parser->flags & MICRO_CONF_FLAG_SORTED) && parser->in_order)
+    i = _micro_conf_merge_find(parser, key, key_len);
+  else
+  {
+    uint32_t hash = _micro_conf_hash(key, key_len);
+    if (!_micro_conf_filter_has(parser, hash))
+      i = _MICRO_CONF_NOT_FOUND;
+    else if ((parser->flags & MICRO_CONF_FLAG_ADAPTIVE) && parser->order &&
+             !parser->prepared && !parser->shared_index)
+      i = _micro_conf_adaptive_find(parser, key, key_len,
+                                    !parser->replaying);
+    else
+      i = _micro_conf_lookup_hashed(parser, key, key_len, hash);
+  }
+  size_t sub_key = 0;
+  if (i == _MICRO_CONF_NOT_FOUND && parser->num_maps > 0)
+    i = _micro_conf_find_map(parser, key, key_len, &sub_key);
+  if (i == _MICRO_CONF_NOT_FOUND && parser->patterns)
+  {
+    size_t match_offset, match_len;
+    size_t p = micro_conf_patterns_match(parser->patterns, key, key_len,
+                                         &match_offset, &match_len);
+    if (p != _MICRO_CONF_NOT_FOUND)
+      return _micro_conf_parse_pattern(parser, line, p, key, key_len,
+                                       match_offset, match_len,
+                                       value_str, value_len);
+  }
+  if (i == _MICRO_CONF_NOT_FOUND)
+  {
+    if (parser->flags & MICRO_CONF_FLAG_UNKNOWN_KEYS)
+      return _micro_conf_fail(parser, MICRO_CONF_ERROR_UNKNOWN_KEY,
+                              (unsigned int)(key - line) + 1,
+                              _MICRO_CONF_NOT_FOUND);
+    return MICRO_CONF_OK;
+  }
+
+  // The key is not missing, even if its value fails
+  _micro_conf_seen(parser)[i / 64] |= (uint64_t)1 << (i % 64);
+
+  line[(value_str - line) + value_len] = '\0';
+  unsigned int column = (unsigned int)(value_str - line) + 1;
+  const MicroConf *conf = &parser->conf[i];
+  MicroConf prepared_entry;
+  if (parser->prepared)
+  {
+    prepared_entry.type = parser->prepared->types[i];
+    prepared_entry.value = parser->prepared->targets[i];
+    prepared_entry.name = parser->prepared->names
+      + parser->prepared->name_offsets[i];
+    conf = &prepared_entry;
+  }
+
+  if (utf8 && _micro_conf_holds_text(conf) &&
+      !_micro_conf_utf8_valid(value_str, value_len))
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_INVALID_UTF8, column,
+                            i);
+
+  if (sub_key > 0)
+  {
+    int err = _micro_conf_map_value(parser, conf, i, key + sub_key,
+                                    key_len - sub_key, value_str,
+                                    value_len);
+    if (err != MICRO_CONF_OK)
+      return _micro_conf_fail(parser, err, column, i);
+  }
+  // Lazy values are converted on first access, but still checked
+  // when validating
+  else if ((conf->type & MICRO_CONF_LAZY) && !_micro_conf_dry_run(parser))
+  {
+    int err = _micro_conf_lazy_store(parser, conf, value_str, value_len);
+    if (err != MICRO_CONF_OK)
+      return _micro_conf_fail(parser, err, column, i);
+  }
+  else
+  {
+    MicroConfValue value;
+    int err = _micro_conf_convert(MICRO_CONF_TYPE(conf->type), value_str,
+                                  value_len, &value);
+    if (err == MICRO_CONF_OK && parser->validate)
+      err = parser->validate(parser->validate_user, i, &value, value_len);
+    if (err != MICRO_CONF_OK)
+      return _micro_conf_fail(parser, err, column, i);
+
+    if (!_micro_conf_dry_run(parser))
+    {
+      err = _micro_conf_seqlocked(parser)
+        ? _micro_conf_stage_value(parser, conf, &value)
+        : _micro_conf_store(parser, conf, &value, value_len);
+      if (err != MICRO_CONF_OK)
+        return _micro_conf_fail(parser, err, column, i);
+    }
+  }
+  if (parser->staging)
+  {
+    int err = _micro_conf_stage_line(parser, line, (size_t)(value_str - line)
+                                     + value_len);
+    if (err != MICRO_CONF_OK)
+      return _micro_conf_fail(parser, err, column, i);
+  }
+
+  _micro_conf_resolved(parser)[i / 64] |= (uint64_t)1 << (i % 64);
+  if (parser->provenance)
+  {
+    MicroConfProvenance *provenance = &parser->provenance[i];
+    provenance->source = parser->source_id;
+    provenance->line = parser->line_number;
+    provenance->offset = parser->line_offset + (uint64_t)(value_str - line);
+  }
+  return MICRO_CONF_OK;
+}
+
+static const uint32_t _micro_conf_sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define _MICRO_CONF_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _micro_conf_sha256_block(uint32_t *state,
+                                     const unsigned char *block)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; ++i)
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16
+      | (uint32_t)block[4 * i + 2] << 8 | (uint32_t)block[4 * i + 3];
+  for (int i = 16; i < 64; ++i)
+  {
+    uint32_t s0 = _MICRO_CONF_ROTR(w[i - 15], 7)
+      ^ _MICRO_CONF_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = _MICRO_CONF_ROTR(w[i - 2], 17)
+      ^ _MICRO_CONF_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; ++i)
+  {
+    uint32_t s1 = _MICRO_CONF_ROTR(e, 6) ^ _MICRO_CONF_ROTR(e, 11)
+      ^ _MICRO_CONF_ROTR(e, 25);
+    uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + _micro_conf_sha256_k[i]
+      + w[i];
+    uint32_t s0 = _MICRO_CONF_ROTR(a, 2) ^ _MICRO_CONF_ROTR(a, 13)
+      ^ _MICRO_CONF_ROTR(a, 22);
+    uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+MICRO_CONF_DEF void
+micro_conf_digest_init(MicroConfDigest *digest)
+{
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  if (!digest) return;
+  memset(digest, 0, sizeof(*digest));
+  memcpy(digest->state, initial, sizeof(initial));
+}
+
+MICRO_CONF_DEF void
+micro_conf_digest_init_hmac(MicroConfDigest *digest, const void *key,
+                            size_t key_len)
+{
+  if (!digest) return;
+  unsigned char padded[64] = {0};
+  if (key_len > sizeof(padded))
+  {
+    micro_conf_digest_init(digest);
+    micro_conf_digest_update(digest, key, key_len);
+    micro_conf_digest_final(digest, padded);
+  }
+  else if (key_len > 0)
+  {
+    memcpy(padded, key, key_len);
+  }
+
+  micro_conf_digest_init(digest);
+  unsigned char inner[64];
+  for (size_t i = 0; i < sizeof(inner); ++i)
+    inner[i] = padded[i] ^ 0x36;
+  micro_conf_digest_update(digest, inner, sizeof(inner));
+  memcpy(digest->key, padded, sizeof(padded));
+  digest->hmac = true;
+}
+
+MICRO_CONF_DEF void
+micro_conf_digest_update(MicroConfDigest *digest, const void *data,
+                         size_t size)
+{
+  if (!digest) return;
+  const unsigned char *bytes = (const unsigned char*)data;
+  digest->length += size;
+
+  if (digest->block_len > 0)
+  {
+    size_t take = 64 - digest->block_len;
+    if (take > size) take = size;
+    memcpy(digest->block + digest->block_len, bytes, take);
+    digest->block_len += take;
+    bytes += take;
+    size -= take;
+    if (digest->block_len < 64) return;
+    _micro_conf_sha256_block(digest->state, digest->block);
+    digest->block_len = 0;
+  }
+  for (; size >= 64; bytes += 64, size -= 64)
+    _micro_conf_sha256_block(digest->state, bytes);
+  memcpy(digest->block, bytes, size);
+  digest->block_len = size;
+}
+
+MICRO_CONF_DEF void
+micro_conf_digest_final(MicroConfDigest *digest, unsigned char *out)
+{
+  if (!digest || !out) return;
+  uint64_t bits = digest->length * 8;
+  unsigned char pad[72] = {0x80};
+  size_t pad_len = (digest->block_len < 56 ? 56 : 120) - digest->block_len;
+  for (int i = 0; i < 8; ++i)
+    pad[pad_len + (size_t)i] = (unsigned char)(bits >> (56 - 8 * i));
+  micro_conf_digest_update(digest, pad, pad_len + 8);
+
+  for (int i = 0; i < 8; ++i)
+  {
+    out[4 * i]     = (unsigned char)(digest->state[i] >> 24);
+    out[4 * i + 1] = (unsigned char)(digest->state[i] >> 16);
+    out[4 * i + 2] = (unsigned char)(digest->state[i] >> 8);
+    out[4 * i + 3] = (unsigned char)digest->state[i];
+  }
+
+  if (digest->hmac)
+  {
+    unsigned char outer[64];
+    for (size_t i = 0; i < sizeof(outer); ++i)
+      outer[i] = digest->key[i] ^ 0x5c;
+    micro_conf_digest_init(digest);
+    micro_conf_digest_update(digest, outer, sizeof(outer));
+    micro_conf_digest_update(digest, out, MICRO_CONF_DIGEST_SIZE);
+    micro_conf_digest_final(digest, out);
+  }
+}
+
+// Append [size] bytes of [data] to the line buffer of [parser],
+// keeping space for a NUL terminator
+static int _micro_conf_line_append(MicroConfParser *parser,
+                                   const char *data, size_t size)
+{
+  size_t needed = parser->line_len + size + 1;
+#ifdef MICRO_CONF_NO_MALLOC
+  if (needed > parser->line_cap) return MICRO_CONF_ERROR_LINE_TOO_LONG;
+#else
+  if (needed > parser->line_cap)
+  {
+    size_t cap = parser->line_cap ? parser->line_cap : 128;
+    while (cap < needed) cap *= 2;
+    char *line = (char*)parser->allocator.realloc(parser->allocator.user,
+                                                  parser->line,
+                                                  parser->line_cap, cap);
+    if (!line) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    parser->line = line;
+    parser->line_cap = cap;
+  }
+#endif
+  memcpy(parser->line + parser->line_len, data, size);
+  parser->line_len += size;
+  parser->line[parser->line_len] = '\0';
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_parser_begin(MicroConfParser *parser, MicroConf *conf,
+                        size_t num_conf)
+{
+  if (!parser) return MICRO_CONF_ERROR_PARSER_NULL;
+
+  parser->line_len = 0;
+  parser->line_number = 0;
+  parser->offset = 0;
+  parser->line_offset = 0;
+  parser->staging = parser->digest && parser->expected_digest &&
+    !(parser->flags & MICRO_CONF_FLAG_DRY_RUN);
+  parser->num_staged = 0;
+  parser->stage_len = 0;
+  parser->num_staged_values = 0;
+  parser->num_errors = 0;
+  parser->halted = false;
+  parser->diag.error = MICRO_CONF_OK;
+  parser->diag.line = 0;
+  parser->diag.column = 0;
+  parser->diag.entry = _MICRO_CONF_NOT_FOUND;
+  if (!conf)
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_CONF_NULL, 0,
+                            _MICRO_CONF_NOT_FOUND);
+
+  if (parser->conf != conf || parser->num_conf != num_conf)
+  {
+    // Stop using the schema set by `micro_conf_parser_use_schema`
+    if (parser->shared_index &&
+        parser->validate == micro_conf_schema_validate)
+      parser->validate = NULL;
+    parser->shared_index = NULL;
+    parser->prepared = NULL;
+    micro_conf_index_destroy(&parser->index);
+    _micro_conf_release(&parser->allocator, parser->order,
+                        2 * parser->order_len * sizeof(uint32_t));
+    parser->order = NULL;
+    parser->hits = NULL;
+    parser->order_len = 0;
+    parser->conf = conf;
+    parser->num_conf = num_conf;
+    parser->required_ready = false;
+  }
+  // Without an index, lookups fall back to a linear scan. Sorted
+  // parses build it only if the input turns out not to be sorted.
+  if (!(parser->flags & (MICRO_CONF_FLAG_SORTED | MICRO_CONF_FLAG_ADAPTIVE))
+      && !parser->shared_index && !parser->prepared && !parser->index.slots)
+    (void) micro_conf_index_build(&parser->index, parser->allocator,
+                                  conf, num_conf);
+  if ((parser->flags & MICRO_CONF_FLAG_ADAPTIVE) && !parser->order &&
+      num_conf > 0 && num_conf < UINT32_MAX)
+  {
+    // Start in declaration order
+    uint32_t *order = (uint32_t*)parser->allocator.alloc(
+      parser->allocator.user, 2 * num_conf * sizeof(uint32_t));
+    if (order)
+    {
+      for (size_t i = 0; i < num_conf; ++i)
+      {
+        order[i] = (uint32_t)i;
+        order[num_conf + i] = 0;
+      }
+      parser->order = order;
+      parser->hits = order + num_conf;
+      parser->order_len = num_conf;
+    }
+  }
+  parser->cursor = 0;
+  parser->in_order = true;
+
+  // Conversions cached by `micro_conf_lazy_get` belong to the
+  // previous parse
+  if (!(parser->flags & MICRO_CONF_FLAG_DRY_RUN))
+    for (size_t i = 0; i < num_conf; ++i)
+      if ((conf[i].type & MICRO_CONF_LAZY) && conf[i].value)
+        ((MicroConfLazy*)conf[i].value)->converted = false;
+
+  // Readers of a seqlock may see any value, so it cannot hold
+  // pointers that a parse frees
+  if (_micro_conf_seqlocked(parser))
+    for (size_t i = 0; i < num_conf; ++i)
+    {
+      MicroConfType type = MICRO_CONF_TYPE(conf[i].type);
+      if (type == MICRO_CONF_STR || type == MICRO_CONF_MAP ||
+          (conf[i].type & MICRO_CONF_LAZY))
+        return _micro_conf_fail(parser, MICRO_CONF_ERROR_INVALID_SCHEMA, 0,
+                                i);
+    }
+
+  size_t words = MICRO_CONF_BITSET_WORDS(num_conf);
+  if (num_conf > MICRO_CONF_INLINE_ENTRIES && parser->bits_cap < 3 * words)
+  {
+    uint64_t *bits = (uint64_t*)parser->allocator.realloc(
+      parser->allocator.user, parser->bits,
+      parser->bits_cap * sizeof(uint64_t), 3 * words * sizeof(uint64_t));
+    if (!bits)
+      return _micro_conf_fail(parser, MICRO_CONF_ERROR_OUT_OF_MEMORY, 0,
+                              _MICRO_CONF_NOT_FOUND);
+    parser->bits = bits;
+    parser->bits_cap = 3 * words;
+    parser->required_ready = false;
+  }
+  // The entries set and the entries seen
+  memset(_micro_conf_resolved(parser), 0, 2 * words * sizeof(uint64_t));
+
+  if (!parser->required_ready)
+  {
+    uint64_t *required = _micro_conf_required(parser);
+    memset(required, 0, words * sizeof(uint64_t));
+    parser->num_maps = 0;
+    for (size_t i = 0; i < num_conf; ++i)
+    {
+      if (conf[i].type & MICRO_CONF_REQUIRED)
+        required[i / 64] |= (uint64_t)1 << (i % 64);
+      if (MICRO_CONF_TYPE(conf[i].type) == MICRO_CONF_MAP)
+        parser->num_maps++;
+    }
+    _micro_conf_filter_build(parser);
+    parser->required_ready = true;
+  }
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_parser_feed(MicroConfParser *parser, const char *data,
+                       size_t size)
+{
+  if (!parser) return MICRO_CONF_ERROR_PARSER_NULL;
+  if (parser->halted) return parser->diag.error;
+  if (parser->digest) micro_conf_digest_update(parser->digest, data, size);
+
+  while (size > 0)
+  {
+    const char *nl = (const char*)memchr(data, '\n', size);
+    size_t take = nl ? (size_t)(nl - data) : size;
+
+    int err = _micro_conf_line_append(parser, data, take);
+    if (err != MICRO_CONF_OK)
+    {
+      // The error belongs to the line being assembled
+      parser->line_number++;
+      return _micro_conf_fail(parser, err, 0, _MICRO_CONF_NOT_FOUND);
+    }
+    data += take;
+    size -= take;
+    parser->offset += take;
+    if (!nl) break;
+
+    data++;
+    size--;
+    parser->offset++;
+    parser->line_number++;
+    err = _micro_conf_parse_line(parser, parser->line, parser->line_len);
+    parser->line_len = 0;
+    parser->line_offset = parser->offset;
+    if (parser->halted) return err;
+  }
+
+  return MICRO_CONF_OK;
+}
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+MICRO_CONF_DEF uint32_t
+micro_conf_seqlock_read_begin(const MicroConfSeqlock *seqlock)
+{
+  uint32_t sequence;
+  while ((sequence = __atomic_load_n(&seqlock->sequence, __ATOMIC_ACQUIRE))
+         & 1) {}
+  return sequence;
+}
+
+MICRO_CONF_DEF bool
+micro_conf_seqlock_read_retry(const MicroConfSeqlock *seqlock,
+                              uint32_t sequence)
+{
+  // Order the reads of the variables before the second load
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&seqlock->sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+static void _micro_conf_seqlock_write_begin(MicroConfSeqlock *seqlock)
+{
+  __atomic_store_n(&seqlock->sequence, seqlock->sequence + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _micro_conf_seqlock_write_end(MicroConfSeqlock *seqlock)
+{
+  __atomic_store_n(&seqlock->sequence, seqlock->sequence + 1,
+                   __ATOMIC_RELEASE);
+}
+
+// Write the staged values inside a write of the seqlock, with
+// relaxed atomic stores since readers load the variables meanwhile
+static void _micro_conf_commit_values(MicroConfParser *parser)
+{
+  _micro_conf_seqlock_write_begin(parser->seqlock);
+  for (size_t v = 0; v < parser->num_staged_values; ++v)
+  {
+    MicroConfStagedValue *staged = &parser->staged_values[v];
+    void *target = staged->target;
+    MicroConfValue *value = &staged->value;
+    switch (staged->type)
+    {
+    case MICRO_CONF_BOOL:
+      __atomic_store((bool*)target, &value->b, __ATOMIC_RELAXED);
+      break;
+    case MICRO_CONF_INT:
+      __atomic_store((int*)target, &value->i, __ATOMIC_RELAXED);
+      break;
+    case MICRO_CONF_FLOAT:
+      __atomic_store((float*)target, &value->f, __ATOMIC_RELAXED);
+      break;
+    case MICRO_CONF_DOUBLE:
+      __atomic_store((double*)target, &value->d, __ATOMIC_RELAXED);
+      break;
+    case MICRO_CONF_CHAR:
+      __atomic_store((char*)target, &value->c, __ATOMIC_RELAXED);
+      break;
+    default:
+      break;
+    }
+  }
+  _micro_conf_seqlock_write_end(parser->seqlock);
+  parser->num_staged_values = 0;
+}
+#endif // MICRO_CONF_HAS_ATOMICS
+
+// Compare the digest of the whole input with the expected one, in
+// constant time
+static int _micro_conf_check_digest(MicroConfParser *parser)
+{
+  unsigned char digest[MICRO_CONF_DIGEST_SIZE];
+  micro_conf_digest_final(parser->digest, digest);
+  unsigned char diff = 0;
+  for (size_t i = 0; i < MICRO_CONF_DIGEST_SIZE; ++i)
+    diff |= digest[i] ^ parser->expected_digest[i];
+  if (diff != 0)
+    return _micro_conf_fail_at(parser, MICRO_CONF_ERROR_DIGEST_MISMATCH,
+                               0, 0, _MICRO_CONF_NOT_FOUND);
+  return MICRO_CONF_OK;
+}
+
+// Write the values of the staged lines. They go through the line
+// buffer again, so errors report the text of their line, and the
+// adaptive order does not count them twice.
+static int _micro_conf_commit_staged(MicroConfParser *parser)
+{
+  parser->staging = false;
+  parser->replaying = true;
+  // The lines were already found once, in this order
+  parser->cursor = 0;
+  parser->in_order = true;
+  unsigned int line_number = parser->line_number;
+  for (size_t s = 0; s < parser->num_staged; ++s)
+  {
+    const MicroConfStaged *staged = &parser->staged[s];
+    parser->line_number = staged->line;
+    parser->line_offset = staged->offset;
+    parser->line_len = 0;
+    int err = _micro_conf_line_append(parser,
+                                      parser->stage_text + staged->text,
+                                      staged->len);
+    if (err != MICRO_CONF_OK)
+      (void) _micro_conf_fail(parser, err, 0, _MICRO_CONF_NOT_FOUND);
+    else
+      (void) _micro_conf_parse_line(parser, parser->line, parser->line_len);
+    parser->line_len = 0;
+    if (parser->halted) break;
+  }
+  parser->replaying = false;
+  if (parser->halted) return parser->diag.error;
+  parser->line_number = line_number;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_parser_end(MicroConfParser *parser)
+{
+  if (!parser) return MICRO_CONF_ERROR_PARSER_NULL;
+  if (parser->halted) return parser->diag.error;
+
+  if (parser->line_len > 0)
+  {
+    parser->line_number++;
+    (void) _micro_conf_parse_line(parser, parser->line, parser->line_len);
+    parser->line_len = 0;
+    if (parser->halted) return parser->diag.error;
+  }
+
+  // Also in dry runs, which do not stage the values
+  if (parser->digest && parser->expected_digest)
+  {
+    int err = _micro_conf_check_digest(parser);
+    if (err != MICRO_CONF_OK)
+    {
+      parser->staging = false;
+      return err;
+    }
+  }
+
+  // Report the required entries whose key is not in the input. Those
+  // with a value that failed were already reported.
+  const uint64_t *seen = _micro_conf_seen(parser);
+  const uint64_t *required = _micro_conf_required(parser);
+  size_t words = MICRO_CONF_BITSET_WORDS(parser->num_conf);
+  for (size_t w = 0; w < words && !parser->halted; ++w)
+  {
+    uint64_t missing = required[w] & ~seen[w];
+    while (missing && !parser->halted)
+    {
+      size_t entry = w * 64 + _micro_conf_ctz64(missing);
+      missing &= missing - 1;
+      (void) _micro_conf_fail_at(parser, MICRO_CONF_ERROR_MISSING_KEY, 0, 0,
+                                 entry);
+    }
+  }
+
+  // The values held back until the end are written only if the whole
+  // parse succeeded, also with MICRO_CONF_FLAG_KEEP_GOING
+  if (parser->diag.error != MICRO_CONF_OK)
+  {
+    parser->staging = false;
+    return parser->diag.error;
+  }
+  if (parser->staging)
+  {
+    int err = _micro_conf_commit_staged(parser);
+    if (err != MICRO_CONF_OK) return err;
+  }
+#ifdef MICRO_CONF_HAS_ATOMICS
+  if (parser->seqlock && !(parser->flags & MICRO_CONF_FLAG_DRY_RUN))
+    _micro_conf_commit_values(parser);
+#endif
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF size_t
+micro_conf_parser_missing(const MicroConfParser *parser, size_t *entries,
+                          size_t max_entries)
+{
+  if (!parser || !parser->conf) return 0;
+  const uint64_t *seen = _micro_conf_seen(parser);
+  const uint64_t *required = _micro_conf_required(parser);
+  if (!seen) return 0;
+
+  size_t count = 0;
+  size_t words = MICRO_CONF_BITSET_WORDS(parser->num_conf);
+  for (size_t w = 0; w < words; ++w)
+  {
+    uint64_t missing = required[w] & ~seen[w];
+    while (missing)
+    {
+      if (count < max_entries)
+        entries[count] = w * 64 + _micro_conf_ctz64(missing);
+      count++;
+      missing &= missing - 1;
+    }
+  }
+  return count;
+}
+
+MICRO_CONF_DEF int
+micro_conf_parser_parse_buffer(MicroConfParser *parser, MicroConf *conf,
+                               size_t num_conf, const char *buffer,
+                               size_t size)
+{
+  int err = micro_conf_parser_begin(parser, conf, num_conf);
+  if (err != MICRO_CONF_OK) return err;
+  err = micro_conf_parser_feed(parser, buffer, size);
+  if (err != MICRO_CONF_OK) return err;
+  return micro_conf_parser_end(parser);
+}
+
+// Feed everything [loader] reads to a parse already begun
+static int _micro_conf_feed_loader(MicroConfParser *parser,
+                                   const MicroConfLoader *loader)
+{
+  char chunk[MICRO_CONF_READ_SIZE];
+  for (;;)
+  {
+    size_t read = 0;
+    int err = loader->read(loader->user, chunk, sizeof(chunk), &read);
+    if (err != MICRO_CONF_OK)
+      return _micro_conf_fail(parser, err, 0, _MICRO_CONF_NOT_FOUND);
+    if (read == 0) break;
+
+    err = micro_conf_parser_feed(parser, chunk, read);
+    if (err != MICRO_CONF_OK) return err;
+  }
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_parser_parse_loader(MicroConfParser *parser, MicroConf *conf,
+                               size_t num_conf,
+                               const MicroConfLoader *loader)
+{
+  int err = micro_conf_parser_begin(parser, conf, num_conf);
+  if (err != MICRO_CONF_OK) return err;
+  err = _micro_conf_feed_loader(parser, loader);
+  if (err != MICRO_CONF_OK) return err;
+  return micro_conf_parser_end(parser);
+}
+
+#ifdef MICRO_CONF_ZLIB
+
+static int _micro_conf_gzip_read(void *user, char *buffer, size_t size,
+                                 size_t *read)
+{
+  MicroConfGzip *gzip = (MicroConfGzip*)user;
+  z_stream *stream = &gzip->stream;
+  *read = 0;
+  if (size > (uInt)-1) size = (uInt)-1;
+
+  stream->next_out = (Bytef*)buffer;
+  stream->avail_out = (uInt)size;
+  while (stream->avail_out > 0 && !gzip->done)
+  {
+    if (stream->avail_in == 0)
+    {
+      size_t got = 0;
+      int err = gzip->source.read(gzip->source.user, (char*)gzip->input,
+                                  sizeof(gzip->input), &got);
+      if (err != MICRO_CONF_OK) return err;
+      if (got == 0)
+      {
+        // The input must not stop in the middle of a member
+        if (!gzip->member_end) return MICRO_CONF_ERROR_READING_FILE;
+        gzip->done = true;
+        break;
+      }
+      stream->next_in = gzip->input;
+      stream->avail_in = (uInt)got;
+    }
+
+    int ret = inflate(stream, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END)
+    {
+      // Concatenated gzip files are decompressed one after the other
+      gzip->member_end = true;
+      if (inflateReset(stream) != Z_OK) return MICRO_CONF_ERROR_READING_FILE;
+    }
+    else if (ret == Z_OK)
+      gzip->member_end = false;
+    else if (ret != Z_BUF_ERROR)
+      return MICRO_CONF_ERROR_READING_FILE;
+  }
+
+  *read = size - stream->avail_out;
+  return MICRO_CONF_OK;
+}
+
+// Size of an allocation made for zlib, which frees without it
+typedef union {
+  size_t size;
+  MicroConfValue align;
+} _MicroConfZlibHeader;
+
+static voidpf _micro_conf_zlib_alloc(voidpf opaque, uInt items, uInt size)
+{
+  MicroConfGzip *gzip = (MicroConfGzip*)opaque;
+  if (size != 0 && items > ((size_t)-1 - sizeof(_MicroConfZlibHeader))
+      / size)
+    return Z_NULL;
+  size_t total = sizeof(_MicroConfZlibHeader) + (size_t)items * size;
+  _MicroConfZlibHeader *header = (_MicroConfZlibHeader*)
+    gzip->allocator.alloc(gzip->allocator.user, total);
+  if (!header) return Z_NULL;
+  header->size = total;
+  return header + 1;
+}
+
+static void _micro_conf_zlib_free(voidpf opaque, voidpf address)
+{
+  MicroConfGzip *gzip = (MicroConfGzip*)opaque;
+  if (!address) return;
+  _MicroConfZlibHeader *header = (_MicroConfZlibHeader*)address - 1;
+  _micro_conf_release(&gzip->allocator, header, header->size);
+}
+
+MICRO_CONF_DEF int
+micro_conf_gzip_init(MicroConfGzip *gzip, MicroConfLoader source)
+{
+  return micro_conf_gzip_init_allocator(gzip, source,
+                                        micro_conf_allocator_default());
+}
+
+MICRO_CONF_DEF int
+micro_conf_gzip_init_allocator(MicroConfGzip *gzip, MicroConfLoader source,
+                               MicroConfAllocator allocator)
+{
+  memset(gzip, 0, sizeof(*gzip));
+  gzip->source = source;
+  gzip->allocator = allocator;
+  gzip->stream.zalloc = _micro_conf_zlib_alloc;
+  gzip->stream.zfree = _micro_conf_zlib_free;
+  gzip->stream.opaque = gzip;
+  // 32 detects both the gzip and the zlib headers
+  if (inflateInit2(&gzip->stream, 15 + 32) != Z_OK)
+    return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF MicroConfLoader
+micro_conf_gzip_loader(MicroConfGzip *gzip)
+{
+  MicroConfLoader loader;
+  loader.read = _micro_conf_gzip_read;
+  loader.user = gzip;
+  return loader;
+}
+
+MICRO_CONF_DEF void
+micro_conf_gzip_destroy(MicroConfGzip *gzip)
+{
+  inflateEnd(&gzip->stream);
+}
+
+#endif // MICRO_CONF_ZLIB
+
+#ifndef MICRO_CONF_NO_MALLOC
+
+static int _micro_conf_file_read(void *user, char *buffer, size_t size,
+                                 size_t *read)
+{
+  FILE *file = (FILE*)user;
+  *read = fread(buffer, 1, size, file);
+  if (*read == 0 && ferror(file)) return MICRO_CONF_ERROR_READING_FILE;
+  return MICRO_CONF_OK;
+}
+
+#ifdef MICRO_CONF_ZLIB
+
+// A file whose first bytes were already read to look for the gzip
+// magic, so that pipes work without seeking back
+typedef struct {
+  FILE *file;
+  unsigned char magic[2];
+  size_t magic_pos;  // First byte of [magic] not returned yet
+  size_t magic_len;
+} _MicroConfSniffedFile;
+
+static int _micro_conf_sniffed_read(void *user, char *buffer, size_t size,
+                                    size_t *read)
+{
+  _MicroConfSniffedFile *sniffed = (_MicroConfSniffedFile*)user;
+  size_t n = sniffed->magic_len - sniffed->magic_pos;
+  if (n > size) n = size;
+  memcpy(buffer, sniffed->magic + sniffed->magic_pos, n);
+  sniffed->magic_pos += n;
+  if (n == size)
+  {
+    *read = n;
+    return MICRO_CONF_OK;
+  }
+  int err = _micro_conf_file_read(sniffed->file, buffer + n, size - n, read);
+  // An error after the magic is reported by the next read
+  if (err != MICRO_CONF_OK && n == 0) return err;
+  *read += n;
+  return MICRO_CONF_OK;
+}
+
+#endif // MICRO_CONF_ZLIB
+
+MICRO_CONF_DEF int
+micro_conf_parser_parse(MicroConfParser *parser, MicroConf *conf,
+                        size_t num_conf, const char *pathname)
+{
+  int err = micro_conf_parser_begin(parser, conf, num_conf);
+  if (err != MICRO_CONF_OK) return err;
+
+  FILE *file = fopen(pathname, "rb");
+  if (!file)
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_OPENING_FILE, 0,
+                            _MICRO_CONF_NOT_FOUND);
+
+  MicroConfLoader loader;
+  loader.read = _micro_conf_file_read;
+  loader.user = file;
+
+#ifdef MICRO_CONF_ZLIB
+  // The magic bytes are fed again to whichever path reads the file
+  _MicroConfSniffedFile sniffed;
+  sniffed.file = file;
+  sniffed.magic_pos = 0;
+  sniffed.magic_len = fread(sniffed.magic, 1, 2, file);
+  bool gzipped = sniffed.magic_len == 2
+    && sniffed.magic[0] == 0x1f && sniffed.magic[1] == 0x8b;
+  if (sniffed.magic_len < 2 && ferror(file))
+  {
+    fclose(file);
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_READING_FILE, 0,
+                            _MICRO_CONF_NOT_FOUND);
+  }
+  loader.read = _micro_conf_sniffed_read;
+  loader.user = &sniffed;
+
+  MicroConfGzip *gzip = NULL;
+  if (gzipped)
+  {
+    gzip = (MicroConfGzip*)parser->allocator.alloc(parser->allocator.user,
+                                                   sizeof(*gzip));
+    if (!gzip ||
+        micro_conf_gzip_init_allocator(gzip, loader, parser->allocator)
+        != MICRO_CONF_OK)
+    {
+      _micro_conf_release(&parser->allocator, gzip, sizeof(*gzip));
+      fclose(file);
+      return _micro_conf_fail(parser, MICRO_CONF_ERROR_OUT_OF_MEMORY, 0,
+                              _MICRO_CONF_NOT_FOUND);
+    }
+    loader = micro_conf_gzip_loader(gzip);
+  }
+#endif
+
+  err = _micro_conf_feed_loader(parser, &loader);
+
+#ifdef MICRO_CONF_ZLIB
+  if (gzip)
+  {
+    micro_conf_gzip_destroy(gzip);
+    _micro_conf_release(&parser->allocator, gzip, sizeof(*gzip));
+  }
+#endif
+
+  if (fclose(file) != 0 && err == MICRO_CONF_OK)
+    return _micro_conf_fail(parser, MICRO_CONF_ERROR_CLOSING_FILE, 0,
+                            _MICRO_CONF_NOT_FOUND);
+  if (err != MICRO_CONF_OK) return err;
+  return micro_conf_parser_end(parser);
+}
+  
+MICRO_CONF_DEF int
+micro_conf_parse(MicroConf *conf, size_t num_conf, const char *pathname)
+{
+  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+
+  MicroConfParser parser;
+  micro_conf_parser_init(&parser);
+  int err = micro_conf_parser_parse(&parser, conf, num_conf, pathname);
+  micro_conf_parser_destroy(&parser);
+  return err;
+}
+
+#endif // MICRO_CONF_NO_MALLOC
+
+//
+// Defaults
+//
+
+// Size of the variable of an entry of [type], or 0 if unknown
+static size_t _micro_conf_type_size(MicroConfType type)
+{
+  switch (type)
+  {
+  case MICRO_CONF_BOOL:   return sizeof(bool);
+  case MICRO_CONF_INT:    return sizeof(int);
+  case MICRO_CONF_FLOAT:  return sizeof(float);
+  case MICRO_CONF_DOUBLE: return sizeof(double);
+  case MICRO_CONF_CHAR:   return sizeof(char);
+  case MICRO_CONF_STR:    return sizeof(char*);
+  default:                return 0;
+  }
+}
+
+static int _micro_conf_compare_copies(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t)((const MicroConfCopy*)a)->dst;
+  uintptr_t y = (uintptr_t)((const MicroConfCopy*)b)->dst;
+  return (x > y) - (x < y);
+}
+
+MICRO_CONF_DEF int
+micro_conf_defaults_build(MicroConfDefaults *plan,
+                          MicroConfAllocator allocator,
+                          const MicroConf *conf,
+                          const MicroConfValue *defaults,
+                          const bool *has_default, size_t num_conf)
+{
+  if (!plan) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(plan, 0, sizeof(*plan));
+  plan->allocator = allocator;
+  if (!conf || !defaults) return MICRO_CONF_ERROR_CONF_NULL;
+
+  size_t num_copies = 0, image_size = 0;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    if (!conf[i].value || (conf[i].type & MICRO_CONF_LAZY) ||
+        MICRO_CONF_TYPE(conf[i].type) == MICRO_CONF_MAP ||
+        (has_default && !has_default[i]))
+      continue;
+    size_t size = _micro_conf_type_size(MICRO_CONF_TYPE(conf[i].type));
+    if (size == 0) return MICRO_CONF_ERROR_UNKNOWN_TYPE;
+    num_copies++;
+    image_size += size;
+  }
+  if (num_copies == 0) return MICRO_CONF_OK;
+
+  MicroConfCopy *copies = (MicroConfCopy*)
+    allocator.alloc(allocator.user, num_copies * sizeof(MicroConfCopy));
+  unsigned char *image = copies
+    ? (unsigned char*)allocator.alloc(allocator.user, image_size) : NULL;
+  if (!image)
+  {
+    _micro_conf_release(&allocator, copies,
+                        num_copies * sizeof(MicroConfCopy));
+    return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  }
+
+  // One copy per entry, sorted by address
+  size_t n = 0;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    if (!conf[i].value || (conf[i].type & MICRO_CONF_LAZY) ||
+        MICRO_CONF_TYPE(conf[i].type) == MICRO_CONF_MAP ||
+        (has_default && !has_default[i]))
+      continue;
+    copies[n].dst = conf[i].value;
+    copies[n].offset = i;  // Entry, until the image is laid out
+    copies[n].size = _micro_conf_type_size(MICRO_CONF_TYPE(conf[i].type));
+    n++;
+  }
+  qsort(copies, n, sizeof(MicroConfCopy), _micro_conf_compare_copies);
+
+  // Lay out the default bytes in address order, and merge the copies
+  // of variables that are next to each other in memory
+  size_t offset = 0, merged = 0;
+  for (size_t c = 0; c < n; ++c)
+  {
+    size_t entry = copies[c].offset;
+    size_t size = copies[c].size;
+    memcpy(image + offset, &defaults[entry], size);
+
+    MicroConfCopy *last = merged > 0 ? &copies[merged - 1] : NULL;
+    if (last && (unsigned char*)last->dst + last->size
+        == (unsigned char*)copies[c].dst)
+    {
+      last->size += size;
+    }
+    else
+    {
+      copies[merged].dst = copies[c].dst;
+      copies[merged].offset = offset;
+      copies[merged].size = size;
+      merged++;
+    }
+    offset += size;
+  }
+
+  plan->copies = copies;
+  plan->num_copies = merged;
+  plan->copies_cap = num_copies;
+  plan->image = image;
+  plan->image_size = image_size;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_apply_defaults(const MicroConfDefaults *plan)
+{
+  if (!plan) return;
+  for (size_t i = 0; i < plan->num_copies; ++i)
+    memcpy(plan->copies[i].dst, plan->image + plan->copies[i].offset,
+           plan->copies[i].size);
+}
+
+MICRO_CONF_DEF void
+micro_conf_defaults_destroy(MicroConfDefaults *plan)
+{
+  if (!plan) return;
+  _micro_conf_release(&plan->allocator, plan->image, plan->image_size);
+  _micro_conf_release(&plan->allocator, plan->copies,
+                      plan->copies_cap * sizeof(MicroConfCopy));
+  memset(plan, 0, sizeof(*plan));
+}
+
+// Whether the variable of [conf] is saved in snapshots
+static bool _micro_conf_history_tracks(const MicroConf *conf)
+{
+  return conf->value && !(conf->type & MICRO_CONF_LAZY) &&
+    _micro_conf_type_size(MICRO_CONF_TYPE(conf->type)) > 0;
+}
+
+static MicroConfString* _micro_conf_string_header(const char *str)
+{
+  return (MicroConfString*)str - 1;
+}
+
+// Drop the references of the first [limit] values of [snapshot]
+static void _micro_conf_snapshot_release(MicroConfHistory *history,
+                                         MicroConfSnapshot *snapshot,
+                                         size_t limit)
+{
+  for (size_t i = 0; i < limit; ++i)
+  {
+    const MicroConf *conf = &history->conf[i];
+    const char *str = snapshot->values[i].s;
+    if (MICRO_CONF_TYPE(conf->type) != MICRO_CONF_STR || !str ||
+        !_micro_conf_history_tracks(conf))
+      continue;
+    MicroConfString *header = _micro_conf_string_header(str);
+    if (--header->refs == 0)
+      _micro_conf_release(&history->allocator, header,
+                          sizeof(MicroConfString) + header->len + 1);
+  }
+  snapshot->used = false;
+}
+
+// Read the variable of [conf] in [value]. Strings are shared with
+// [prev] if equal, or copied.
+static int _micro_conf_capture(MicroConfHistory *history,
+                               const MicroConf *conf,
+                               const MicroConfValue *prev,
+                               MicroConfValue *value)
+{
+  switch (MICRO_CONF_TYPE(conf->type))
+  {
+  case MICRO_CONF_BOOL:   value->b = *((bool*)conf->value);   break;
+  case MICRO_CONF_INT:    value->i = *((int*)conf->value);    break;
+  case MICRO_CONF_FLOAT:  value->f = *((float*)conf->value);  break;
+  case MICRO_CONF_DOUBLE: value->d = *((double*)conf->value); break;
+  case MICRO_CONF_CHAR:   value->c = *((char*)conf->value);   break;
+  case MICRO_CONF_STR:
+  {
+    const char *str = *((char**)conf->value);
+    value->s = NULL;
+    if (!str) break;
+    if (prev && prev->s && (prev->s == str || strcmp(prev->s, str) == 0))
+    {
+      _micro_conf_string_header(prev->s)->refs++;
+      value->s = prev->s;
+      break;
+    }
+    size_t len = strlen(str);
+    if (len >= UINT32_MAX) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    MicroConfString *header = (MicroConfString*)history->allocator.alloc(
+      history->allocator.user, sizeof(MicroConfString) + len + 1);
+    if (!header) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    header->refs = 1;
+    header->len = (uint32_t)len;
+    memcpy(header + 1, str, len + 1);
+    value->s = (const char*)(header + 1);
+    break;
+  }
+  default:
+    return MICRO_CONF_ERROR_UNKNOWN_TYPE;
+  }
+  return MICRO_CONF_OK;
+}
+
+static bool _micro_conf_value_eq(MicroConfType type, const MicroConfValue *a,
+                                 const MicroConfValue *b)
+{
+  switch (type)
+  {
+  case MICRO_CONF_BOOL:   return a->b == b->b;
+  case MICRO_CONF_INT:    return a->i == b->i;
+  case MICRO_CONF_FLOAT:  return memcmp(&a->f, &b->f, sizeof(float)) == 0;
+  case MICRO_CONF_DOUBLE: return memcmp(&a->d, &b->d, sizeof(double)) == 0;
+  case MICRO_CONF_CHAR:   return a->c == b->c;
+  case MICRO_CONF_STR:    return a->s == b->s;
+  default:                return true;
+  }
+}
+
+// Write [value] to the variable of [conf], without copying strings
+static void _micro_conf_restore(const MicroConf *conf,
+                                const MicroConfValue *value)
+{
+  switch (MICRO_CONF_TYPE(conf->type))
+  {
+  case MICRO_CONF_BOOL:   *((bool*)conf->value) = value->b;         break;
+  case MICRO_CONF_INT:    *((int*)conf->value) = value->i;          break;
+  case MICRO_CONF_FLOAT:  *((float*)conf->value) = value->f;        break;
+  case MICRO_CONF_DOUBLE: *((double*)conf->value) = value->d;       break;
+  case MICRO_CONF_CHAR:   *((char*)conf->value) = value->c;         break;
+  case MICRO_CONF_STR:    *((char**)conf->value) = (char*)value->s; break;
+  default: break;
+  }
+}
+
+MICRO_CONF_DEF int
+micro_conf_history_init(MicroConfHistory *history,
+                        MicroConfAllocator allocator, MicroConf *conf,
+                        size_t num_conf, size_t depth)
+{
+  if (!history) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(history, 0, sizeof(*history));
+  history->allocator = allocator;
+  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+  if (depth == 0) return MICRO_CONF_ERROR_OUT_OF_RANGE;
+  if (num_conf >= UINT32_MAX || depth > SIZE_MAX / 2 / (num_conf + 1)
+      / sizeof(MicroConfValue))
+    return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+
+  size_t words = MICRO_CONF_BITSET_WORDS(num_conf);
+  size_t size = depth * num_conf * sizeof(MicroConfValue)
+    + num_conf * sizeof(char*)
+    + words * sizeof(uint64_t)
+    + depth * sizeof(MicroConfSnapshot)
+    + depth * num_conf * sizeof(uint32_t);
+  unsigned char *memory = (unsigned char*)allocator.alloc(allocator.user,
+                                                          size);
+  if (!memory) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  memset(memory, 0, size);
+
+  MicroConfValue *values = (MicroConfValue*)memory;
+  char **copies = (char**)(values + depth * num_conf);
+  uint64_t *seen = (uint64_t*)(copies + num_conf);
+  MicroConfSnapshot *ring = (MicroConfSnapshot*)(seen + words);
+  uint32_t *changed = (uint32_t*)(ring + depth);
+  for (size_t s = 0; s < depth; ++s)
+  {
+    ring[s].values = values + s * num_conf;
+    ring[s].changed = changed + s * num_conf;
+  }
+
+  history->conf = conf;
+  history->num_conf = num_conf;
+  history->ring = ring;
+  history->depth = depth;
+  history->seen = seen;
+  history->copies = copies;
+  history->memory = memory;
+  history->memory_size = size;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_history_destroy(MicroConfHistory *history)
+{
+  if (!history) return;
+  for (size_t s = 0; s < history->depth; ++s)
+    if (history->ring[s].used)
+      _micro_conf_snapshot_release(history, &history->ring[s],
+                                   history->num_conf);
+  _micro_conf_release(&history->allocator, history->memory,
+                      history->memory_size);
+  memset(history, 0, sizeof(*history));
+}
+
+MICRO_CONF_DEF int
+micro_conf_history_push(MicroConfHistory *history)
+{
+  if (!history || !history->ring) return MICRO_CONF_ERROR_CONF_NULL;
+
+  size_t next = history->count > 0
+    ? (history->head + 1) % history->depth : history->head;
+  MicroConfSnapshot *snapshot = &history->ring[next];
+  // The oldest snapshot, or one discarded by a rollback
+  if (snapshot->used)
+    _micro_conf_snapshot_release(history, snapshot, history->num_conf);
+  const MicroConfSnapshot *prev = history->count > 0
+    ? &history->ring[history->head] : NULL;
+
+  snapshot->num_changed = 0;
+  for (size_t i = 0; i < history->num_conf; ++i)
+  {
+    const MicroConf *conf = &history->conf[i];
+    MicroConfValue *value = &snapshot->values[i];
+    memset(value, 0, sizeof(*value));
+    if (!_micro_conf_history_tracks(conf)) continue;
+
+    int err = _micro_conf_capture(history, conf,
+                                  prev ? &prev->values[i] : NULL, value);
+    if (err != MICRO_CONF_OK)
+    {
+      _micro_conf_snapshot_release(history, snapshot, i);
+      return err;
+    }
+    if (!prev ||
+        !_micro_conf_value_eq(MICRO_CONF_TYPE(conf->type),
+                              &prev->values[i], value))
+      snapshot->changed[snapshot->num_changed++] = (uint32_t)i;
+  }
+
+  snapshot->used = true;
+  snapshot->version = ++history->version;
+  history->head = next;
+  if (history->count < history->depth) history->count++;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_rollback(MicroConfHistory *history, size_t n)
+{
+  if (!history) return MICRO_CONF_ERROR_CONF_NULL;
+  if (n >= history->count) return MICRO_CONF_ERROR_OUT_OF_RANGE;
+
+  size_t depth = history->depth;
+  size_t target = (history->head + depth - n) % depth;
+  const MicroConfValue *values = history->ring[target].values;
+  const MicroConf *conf = history->conf;
+  size_t num_conf = history->num_conf;
+
+  // Mark the entries to write: all of them with [n] 0, otherwise the
+  // changes of the newer snapshots, once per entry
+  uint64_t *seen = history->seen;
+  for (size_t i = 0; n == 0 && i < num_conf; ++i)
+    seen[i / 64] |= (uint64_t)1 << (i % 64);
+  for (size_t k = 0; k < n; ++k)
+  {
+    const MicroConfSnapshot *snapshot =
+      &history->ring[(history->head + depth - k) % depth];
+    for (size_t c = 0; c < snapshot->num_changed; ++c)
+    {
+      uint32_t i = snapshot->changed[c];
+      seen[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+
+  // Copy the strings before writing anything, so that a failed copy
+  // leaves all the variables as they were
+  char **copies = history->copies;
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    copies[i] = NULL;
+    if (!((seen[i / 64] >> (i % 64)) & 1) || !values[i].s ||
+        MICRO_CONF_TYPE(conf[i].type) != MICRO_CONF_STR ||
+        !_micro_conf_history_tracks(&conf[i]))
+      continue;
+    size_t len = _micro_conf_string_header(values[i].s)->len;
+    copies[i] = (char*)history->allocator.alloc(history->allocator.user,
+                                                len + 1);
+    if (!copies[i])
+    {
+      while (i-- > 0)
+        if (copies[i])
+          _micro_conf_release(&history->allocator, copies[i],
+                              strlen(copies[i]) + 1);
+      memset(seen, 0, MICRO_CONF_BITSET_WORDS(num_conf) * sizeof(uint64_t));
+      return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(copies[i], values[i].s, len + 1);
+  }
+
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    if (!((seen[i / 64] >> (i % 64)) & 1) ||
+        !_micro_conf_history_tracks(&conf[i]))
+      continue;
+    MicroConfValue value = values[i];
+    if (MICRO_CONF_TYPE(conf[i].type) == MICRO_CONF_STR)
+      value.s = copies[i];
+    _micro_conf_restore(&conf[i], &value);
+  }
+  memset(seen, 0, MICRO_CONF_BITSET_WORDS(num_conf) * sizeof(uint64_t));
+
+  // Newer snapshots keep their strings until their slot is reused
+  history->head = target;
+  history->count -= n;
+  return MICRO_CONF_OK;
+}
+
+#ifdef MICRO_CONF_HAS_ATOMICS
+static void _micro_conf_spin_lock(int *lock)
+{
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {}
+}
+
+static void _micro_conf_spin_unlock(int *lock)
+{
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static void _micro_conf_published_release(MicroConfPublisher *publisher,
+                                          MicroConfPublished *published)
+{
+  if (__atomic_sub_fetch(&published->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    _micro_conf_release(&publisher->allocator, published,
+                        published->size);
+}
+
+MICRO_CONF_DEF int
+micro_conf_publisher_init(MicroConfPublisher *publisher,
+                          MicroConfAllocator allocator,
+                          const MicroConf *conf, size_t num_conf)
+{
+  if (!publisher) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(publisher, 0, sizeof(*publisher));
+  publisher->allocator = allocator;
+  if (!conf) return MICRO_CONF_ERROR_CONF_NULL;
+  if (num_conf > SIZE_MAX / 2 / sizeof(MicroConfValue))
+    return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  publisher->conf = conf;
+  publisher->num_conf = num_conf;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_publisher_destroy(MicroConfPublisher *publisher)
+{
+  if (!publisher) return;
+  if (publisher->current)
+    _micro_conf_published_release(publisher, publisher->current);
+  memset(publisher, 0, sizeof(*publisher));
+}
+
+MICRO_CONF_DEF int
+micro_conf_publish(MicroConfPublisher *publisher)
+{
+  if (!publisher || !publisher->conf) return MICRO_CONF_ERROR_CONF_NULL;
+
+  // Values and strings are copied in a single allocation
+  const MicroConf *conf = publisher->conf;
+  size_t num_conf = publisher->num_conf;
+  size_t size = sizeof(MicroConfPublished)
+    + num_conf * sizeof(MicroConfValue);
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    if (!_micro_conf_history_tracks(&conf[i]) ||
+        MICRO_CONF_TYPE(conf[i].type) != MICRO_CONF_STR)
+      continue;
+    const char *str = *((char**)conf[i].value);
+    if (str)
+    {
+      size_t len = strlen(str);
+      if (len >= SIZE_MAX / 2 - size) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+      size += len + 1;
+    }
+  }
+
+  MicroConfPublished *published = (MicroConfPublished*)
+    publisher->allocator.alloc(publisher->allocator.user, size);
+  if (!published) return MICRO_CONF_ERROR_OUT_OF_MEMORY;
+  published->refs = 1;
+  published->num_conf = num_conf;
+  published->values = (MicroConfValue*)(published + 1);
+  published->size = size;
+
+  char *strings = (char*)(published->values + num_conf);
+  for (size_t i = 0; i < num_conf; ++i)
+  {
+    MicroConfValue *value = &published->values[i];
+    memset(value, 0, sizeof(*value));
+    if (!_micro_conf_history_tracks(&conf[i])) continue;
+    if (MICRO_CONF_TYPE(conf[i].type) != MICRO_CONF_STR)
+    {
+      (void) _micro_conf_capture(NULL, &conf[i], NULL, value);
+      continue;
+    }
+    const char *str = *((char**)conf[i].value);
+    if (!str) continue;
+    size_t len = strlen(str);
+    memcpy(strings, str, len + 1);
+    value->s = strings;
+    strings += len + 1;
+  }
+
+  _micro_conf_spin_lock(&publisher->lock);
+  MicroConfPublished *old = publisher->current;
+  publisher->current = published;
+  __atomic_store_n(&publisher->generation, publisher->generation + 1,
+                   __ATOMIC_RELEASE);
+  _micro_conf_spin_unlock(&publisher->lock);
+
+  if (old) _micro_conf_published_release(publisher, old);
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_reader_init(MicroConfReader *reader,
+                       MicroConfPublisher *publisher)
+{
+  reader->publisher = publisher;
+  reader->published = NULL;
+  reader->generation = 0;
+}
+
+MICRO_CONF_DEF const MicroConfValue*
+micro_conf_reader_get(MicroConfReader *reader)
+{
+  MicroConfPublisher *publisher = reader->publisher;
+  // The values held by the reader stay valid, so no ordering is
+  // needed until they must be replaced
+  if (__atomic_load_n(&publisher->generation, __ATOMIC_RELAXED)
+      == reader->generation)
+    return reader->published ? reader->published->values : NULL;
+
+  _micro_conf_spin_lock(&publisher->lock);
+  MicroConfPublished *published = publisher->current;
+  if (published)
+    __atomic_add_fetch(&published->refs, 1, __ATOMIC_RELAXED);
+  reader->generation = publisher->generation;
+  _micro_conf_spin_unlock(&publisher->lock);
+
+  if (reader->published)
+    _micro_conf_published_release(publisher, reader->published);
+  reader->published = published;
+  return published ? published->values : NULL;
+}
+
+MICRO_CONF_DEF void
+micro_conf_reader_release(MicroConfReader *reader)
+{
+  if (reader->published)
+    _micro_conf_published_release(reader->publisher, reader->published);
+  reader->published = NULL;
+  reader->generation = 0;
+}
+#endif // MICRO_CONF_HAS_ATOMICS
+
+MICRO_CONF_DEF bool
+micro_conf_parser_from_file(const MicroConfParser *parser, size_t entry)
+{
+  if (!parser || entry >= parser->num_conf) return false;
+  const uint64_t *resolved = _micro_conf_resolved(parser);
+  if (!resolved) return false;
+  return (resolved[entry / 64] >> (entry % 64)) & 1;
+}
+
+MICRO_CONF_DEF const MicroConfProvenance*
+micro_conf_parser_provenance(const MicroConfParser *parser, size_t entry)
+{
+  if (!parser || !parser->provenance || entry >= parser->num_conf)
+    return NULL;
+  if (parser->provenance[entry].line == 0) return NULL;
+  return &parser->provenance[entry];
+}
+
+//
+// Schema
+//
+
+MICRO_CONF_DEF const char*
+micro_conf_type_name(MicroConfType type)
+{
+  switch (type)
+  {
+  case MICRO_CONF_BOOL:   return "bool";
+  case MICRO_CONF_INT:    return "int";
+  case MICRO_CONF_FLOAT:  return "float";
+  case MICRO_CONF_DOUBLE: return "double";
+  case MICRO_CONF_CHAR:   return "char";
+  case MICRO_CONF_STR:    return "str";
+  case MICRO_CONF_MAP:    return "map";
+  default:                return NULL;
+  }
+}
+
+MICRO_CONF_DEF bool
+micro_conf_type_from_name(const char *name, size_t len, MicroConfType *type)
+{
+  static const MicroConfType types[] = {
+    MICRO_CONF_BOOL, MICRO_CONF_INT, MICRO_CONF_FLOAT,
+    MICRO_CONF_DOUBLE, MICRO_CONF_CHAR, MICRO_CONF_STR,
+  };
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+  {
+    if (_micro_conf_name_eq(micro_conf_type_name(types[i]), name, len))
+    {
+      *type = types[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+MICRO_CONF_DEF int
+micro_conf_lazy_get(MicroConfLazy *lazy, MicroConfValue *value)
+{
+  if (!lazy) return MICRO_CONF_ERROR_CONF_NULL;
+  if (lazy->text && !lazy->converted)
+  {
+    lazy->error = _micro_conf_convert(lazy->type, lazy->text, lazy->len,
+                                      &lazy->cached);
+    lazy->converted = true;
+  }
+  bool valid = lazy->text && lazy->error == MICRO_CONF_OK;
+  if (value) *value = valid ? lazy->cached : lazy->value;
+  return lazy->text ? lazy->error : MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_lazy_destroy(MicroConfLazy *lazy)
+{
+  if (!lazy) return;
+  _micro_conf_release(&lazy->allocator, lazy->text, lazy->cap);
+  lazy->text = NULL;
+  lazy->len = 0;
+  lazy->cap = 0;
+  lazy->converted = false;
+  lazy->error = MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF const MicroConfValue*
+micro_conf_map_get(const MicroConfMap *map, const char *key,
+                   size_t key_len)
+{
+  if (!map || map->count == 0 || !key) return NULL;
+
+  uint32_t hash = _micro_conf_hash(key, key_len);
+  size_t mask = map->capacity - 1;
+  for (size_t pos = hash & mask; map->slots[pos].key;
+       pos = (pos + 1) & mask)
+  {
+    const MicroConfMapSlot *slot = &map->slots[pos];
+    if (slot->hash == hash && slot->key_len == key_len &&
+        memcmp(slot->key, key, key_len) == 0)
+      return &slot->value;
+  }
+  return NULL;
+}
+
+MICRO_CONF_DEF void
+micro_conf_map_destroy(MicroConfMap *map)
+{
+  if (!map) return;
+  for (size_t i = 0; i < map->capacity; ++i)
+  {
+    MicroConfMapSlot *slot = &map->slots[i];
+    if (!slot->key) continue;
+    _micro_conf_release(&map->allocator, slot->key, slot->key_len + 1);
+    if (map->type == MICRO_CONF_STR)
+      _micro_conf_release(&map->allocator, (void*)slot->value.s,
+                          strlen(slot->value.s) + 1);
+  }
+  _micro_conf_release(&map->allocator, map->slots,
+                      map->capacity * sizeof(MicroConfMapSlot));
+  map->slots = NULL;
+  map->capacity = 0;
+  map->count = 0;
+}
+
+static int _micro_conf_sort_cmp(const void *a, const void *b)
+{
+  return strcmp(((const MicroConf*)a)->name, ((const MicroConf*)b)->name);
+}
+
+MICRO_CONF_DEF void
+micro_conf_sort(MicroConf *conf, size_t num_conf)
+{
+  if (!conf || num_conf < 2) return;
+  qsort(conf, num_conf, sizeof(MicroConf), _micro_conf_sort_cmp);
+}
+
+// Give the characters of [chars] the class [role] in [table]
+static int _micro_conf_syntax_set(MicroConfSyntaxTable *table,
+                                  const char *chars, unsigned char role)
+{
+  for (; *chars; ++chars)
+  {
+    unsigned char c = (unsigned char)*chars;
+    if (c == '\n' || (table->classes[c] & ~role))
+      return MICRO_CONF_ERROR_INVALID_SCHEMA;
+    table->classes[c] |= role;
+  }
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_syntax_compile(MicroConfSyntaxTable *table,
+                          const MicroConfSyntax *syntax)
+{
+  if (!table || !syntax) return MICRO_CONF_ERROR_CONF_NULL;
+  memset(table, 0, sizeof(*table));
+  table->inline_comments = !syntax->no_inline_comments;
+
+  int err = _micro_conf_syntax_set(table, syntax->whitespace
+                                   ? syntax->whitespace : " \t",
+                                   MICRO_CONF_CLASS_SPACE);
+  if (err == MICRO_CONF_OK)
+    err = _micro_conf_syntax_set(table, syntax->separators
+                                 ? syntax->separators : "=:",
+                                 MICRO_CONF_CLASS_SEPARATOR);
+  if (err != MICRO_CONF_OK) return err;
+
+  const char *marker = syntax->comments ? syntax->comments : "#";
+  bool first = true;
+  while (*marker)
+  {
+    if (*marker == ' ')
+    {
+      marker++;
+      continue;
+    }
+    size_t len = strcspn(marker, " ");
+    if (len > 2) return MICRO_CONF_ERROR_INVALID_SCHEMA;
+    unsigned char c = (unsigned char)marker[0];
+    if (c == '\n' || (table->classes[c] & ~MICRO_CONF_CLASS_COMMENT))
+      return MICRO_CONF_ERROR_INVALID_SCHEMA;
+    // A single byte marker covers the longer ones with the same start
+    if (!(table->classes[c] & MICRO_CONF_CLASS_COMMENT))
+      table->comment_next[c] = len == 2 ? (unsigned char)marker[1] : 0;
+    else if (len == 1)
+      table->comment_next[c] = 0;
+    else if (table->comment_next[c] != 0 &&
+             table->comment_next[c] != (unsigned char)marker[1])
+      return MICRO_CONF_ERROR_INVALID_SCHEMA;
+    table->classes[c] |= MICRO_CONF_CLASS_COMMENT;
+    table->comment_start = first || table->comment_start == c ? c : 0;
+    first = false;
+    marker += len;
+  }
+
+  // Printable characters without a role can be part of keys
+  for (size_t c = 0; c < 256; ++c)
+  {
+    if (!table->classes[c] && c > ' ' && c != 0x7f)
+      table->classes[c] = MICRO_CONF_CLASS_KEY;
+    if (c >= '0' && c <= '9') table->classes[c] |= MICRO_CONF_CLASS_DIGIT;
+  }
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF size_t
+micro_conf_keyword_find(const char *const *keywords, size_t num_keywords,
+                        const char *str, size_t len)
+{
+  if (!keywords || !str) return _MICRO_CONF_NOT_FOUND;
+
+  if (len <= 8)
+  {
+    uint64_t word = _micro_conf_word_lower(_micro_conf_word(str, len));
+    for (size_t i = 0; i < num_keywords; ++i)
+    {
+      size_t keyword_len = strlen(keywords[i]);
+      if (keyword_len != len) continue;
+      if (_micro_conf_word_lower(_micro_conf_word(keywords[i], len)) == word)
+        return i;
+    }
+    return _MICRO_CONF_NOT_FOUND;
+  }
+
+  for (size_t i = 0; i < num_keywords; ++i)
+  {
+    const char *keyword = keywords[i];
+    size_t j = 0;
+    for (; j < len; j += 8)
+    {
+      size_t chunk = len - j < 8 ? len - j : 8;
+      if (memchr(keyword + j, '\0', chunk)) break;
+      if (_micro_conf_word_lower(_micro_conf_word(keyword + j, chunk))
+          != _micro_conf_word_lower(_micro_conf_word(str + j, chunk)))
+        break;
+    }
+    if (j >= len && keyword[len] == '\0') return i;
+  }
+  return _MICRO_CONF_NOT_FOUND;
+}
+
+MICRO_CONF_DEF const char*
+micro_conf_error_string(int error)
+{
+  switch (error)
+  {
+  case MICRO_CONF_OK:                   return "ok";
+  case MICRO_CONF_ERROR_CONF_NULL:      return "conf is NULL";
+  case MICRO_CONF_ERROR_OPENING_FILE:   return "error opening file";
+  case MICRO_CONF_ERROR_CLOSING_FILE:   return "error closing file";
+  case MICRO_CONF_ERROR_UNKNOWN_TYPE:   return "unknown type";
+  case MICRO_CONF_ERROR_INVALID_BOOL:   return "invalid bool";
+  case MICRO_CONF_ERROR_INVALID_INT:    return "invalid int";
+  case MICRO_CONF_ERROR_INVALID_DOUBLE: return "invalid double";
+  case MICRO_CONF_ERROR_INVALID_FLOAT:  return "invalid float";
+  case MICRO_CONF_ERROR_INVALID_CHAR:   return "invalid char";
+  case MICRO_CONF_ERROR_OUT_OF_MEMORY:  return "out of memory";
+  case MICRO_CONF_ERROR_READING_FILE:   return "error reading file";
+  case MICRO_CONF_ERROR_PARSER_NULL:    return "parser is NULL";
+  case MICRO_CONF_ERROR_LINE_TOO_LONG:  return "line too long";
+  case MICRO_CONF_ERROR_UNKNOWN_KEY:    return "unknown key";
+  case MICRO_CONF_ERROR_INVALID_SCHEMA: return "invalid schema";
+  case MICRO_CONF_ERROR_OUT_OF_RANGE:   return "value out of range";
+  case MICRO_CONF_ERROR_MISSING_KEY:    return "missing required key";
+  case MICRO_CONF_ERROR_DIGEST_MISMATCH: return "digest does not match";
+  case MICRO_CONF_ERROR_INVALID_UTF8:   return "invalid UTF-8";
+  default:                              return "unknown error";
+  }
+}
+
+MICRO_CONF_DEF void
+micro_conf_schema_init(MicroConfSchema *schema, MicroConfAllocator allocator)
+{
+  if (!schema) return;
+  memset(schema, 0, sizeof(*schema));
+  schema->allocator = allocator;
+  schema->diag.entry = _MICRO_CONF_NOT_FOUND;
+}
+
+MICRO_CONF_DEF void
+micro_conf_schema_destroy(MicroConfSchema *schema)
+{
+  if (!schema) return;
+  micro_conf_index_destroy(&schema->index);
+  _micro_conf_release(&schema->allocator, schema->memory,
+                      schema->memory_size);
+  micro_conf_schema_init(schema, schema->allocator);
+}
+
+static int _micro_conf_schema_fail(MicroConfSchema *schema, int error,
+                                   unsigned int line, unsigned int column)
+{
+  schema->diag.error = error;
+  schema->diag.line = line;
+  schema->diag.column = column;
+  schema->diag.entry = _MICRO_CONF_NOT_FOUND;
+  return error;
+}
 
-      if (*after_name == '=' || *after_name == ':') after_name++;
-      space = left_space(after_name, (int)(read - (after_name - line)), NULL, NULL);
-      after_name += space;
+// A line of a schema file
+typedef struct {
+  const char *name;
+  size_t name_len;
+  MicroConfType type;
+  const char *default_str;
+  size_t default_len;
+  MicroConfRange range;
+  bool required;
+} _MicroConfSchemaLine;
 
-      char *value_str = after_name;
-      size_t vlen = strlen(value_str);
-      while (vlen > 0 && (value_str[vlen-1] == '\n' || value_str[vlen-1] == ' '))
-        value_str[--vlen] = '\0';
+// Parse the number in the [len] bytes of [str]
+static bool _micro_conf_parse_number(const char *str, size_t len,
+                                     double *number)
+{
+  char buf[64];
+  if (len == 0 || len >= sizeof(buf)) return false;
+  memcpy(buf, str, len);
+  buf[len] = '\0';
 
-      switch (conf[i].type)
-      {
-      case MICRO_CONF_BOOL:
+  char *endptr;
+  *number = strtod(buf, &endptr);
+  return *endptr == '\0';
+}
+
+// Parse the [len] bytes of [line] into [out]. Returns
+// MICRO_CONF_ERROR_INVALID_SCHEMA and the offending [column] on error,
+// or MICRO_CONF_OK with out->name set to NULL if the line is empty.
+static int _micro_conf_schema_split(const char *line, size_t len,
+                                    _MicroConfSchemaLine *out,
+                                    unsigned int *column)
+{
+  const char *value;
+  size_t value_len;
+  memset(out, 0, sizeof(*out));
+  if (!_micro_conf_split_line(&_micro_conf_syntax_default, line, len,
+                              &out->name, &out->name_len,
+                              &value, &value_len))
+  {
+    out->name = NULL;
+    return MICRO_CONF_OK;
+  }
+
+  // The value ends at a comment outside of quotes, so that quoted
+  // defaults can contain comment markers
+  const unsigned char *classes = _micro_conf_syntax_default.classes;
+  const char *line_end = line + len;
+  if (line_end > line && line_end[-1] == '\r') line_end--;
+  const char *end = value;
+  bool quoted = false;
+  for (; end < line_end; ++end)
+  {
+    if (*end == '"') quoted = !quoted;
+    else if (!quoted &&
+             _micro_conf_comment_at(&_micro_conf_syntax_default, end,
+                                    line_end))
+      break;
+  }
+  while (end > value &&
+         (classes[(unsigned char)end[-1]] & MICRO_CONF_CLASS_SPACE))
+    end--;
+
+  const char *token = value;
+  bool has_type = false;
+  while (token < end)
+  {
+    const char *token_end = token;
+    if (token_end + 9 <= end && strncmp(token_end, "default=\"", 9) == 0)
+    {
+      // Quoted default, can contain spaces, and ends at the quote
+      const char *quote = (const char*)memchr(token + 9, '"',
+                                              (size_t)(end - token - 9));
+      if (!quote) goto invalid;
+      token_end = quote + 1;
+      if (token_end < end &&
+          !(classes[(unsigned char)*token_end] & MICRO_CONF_CLASS_SPACE))
       {
-        if (strcmp(value_str, "true") == 0 || strcmp(value_str, "1") == 0)
-        {
-          *((bool*)conf[i].value) = true;
-        }
-        else if (strcmp(value_str, "false") == 0 || strcmp(value_str, "0") == 0)
-        {
-          *((bool*)conf[i].value) = false;
-        }
-        else
-        {
-          free(line);
-          fclose(file);
-          return MICRO_CONF_ERROR_INVALID_BOOL;
-        }
-        break;
+        *column = (unsigned int)(token_end - line) + 1;
+        goto invalid;
       }
-      case MICRO_CONF_CHAR:
+    }
+    while (token_end < end &&
+           !(classes[(unsigned char)*token_end] & MICRO_CONF_CLASS_SPACE))
+      token_end++;
+    size_t token_len = (size_t)(token_end - token);
+    *column = (unsigned int)(token - line) + 1;
+
+    if (!has_type)
+    {
+      if (!micro_conf_type_from_name(token, token_len, &out->type))
+        goto invalid;
+      has_type = true;
+    }
+    else if (_micro_conf_name_eq("required", token, token_len))
+    {
+      out->required = true;
+    }
+    else if (token_len > 8 && strncmp(token, "default=", 8) == 0)
+    {
+      out->default_str = token + 8;
+      out->default_len = token_len - 8;
+      if (out->default_str[0] == '"')
       {
-        if (strlen(value_str) == 1)
-        {
-          *((char*)conf[i].value) = value_str[0];
-        }
-        else
-        {
-          free(line);
-          fclose(file);
-          return MICRO_CONF_ERROR_INVALID_CHAR;
-        }
-        break;
+        out->default_str++;
+        out->default_len -= 2;
       }
-      case MICRO_CONF_STR:
+    }
+    else if (token_len > 4 && strncmp(token, "min=", 4) == 0)
+    {
+      if (!_micro_conf_parse_number(token + 4, token_len - 4,
+                                    &out->range.min))
+        goto invalid;
+      out->range.flags |= MICRO_CONF_RANGE_MIN;
+    }
+    else if (token_len > 4 && strncmp(token, "max=", 4) == 0)
+    {
+      if (!_micro_conf_parse_number(token + 4, token_len - 4,
+                                    &out->range.max))
+        goto invalid;
+      out->range.flags |= MICRO_CONF_RANGE_MAX;
+    }
+    else
+    {
+      goto invalid;
+    }
+
+    token = token_end;
+    while (token < end &&
+           (classes[(unsigned char)*token] & MICRO_CONF_CLASS_SPACE))
+      token++;
+  }
+
+  *column = (unsigned int)(value - line) + 1;
+  if (out->name_len == 0 || !has_type) goto invalid;
+  if (out->range.flags != 0 &&
+      (out->type == MICRO_CONF_BOOL || out->type == MICRO_CONF_CHAR))
+    goto invalid;
+  return MICRO_CONF_OK;
+
+ invalid:
+  return MICRO_CONF_ERROR_INVALID_SCHEMA;
+}
+
+#define _MICRO_CONF_ALIGN_UP(size) \
+  (((size) + sizeof(MicroConfValue) - 1) & ~(sizeof(MicroConfValue) - 1))
+
+MICRO_CONF_DEF int
+micro_conf_schema_parse(MicroConfSchema *schema, const char *buffer,
+                        size_t size)
+{
+  if (!schema) return MICRO_CONF_ERROR_CONF_NULL;
+  if (!buffer && size > 0) return MICRO_CONF_ERROR_CONF_NULL;
+  micro_conf_schema_destroy(schema);
+  if (size >= 3 && memcmp(buffer, _MICRO_CONF_BOM, 3) == 0)
+  {
+    buffer += 3;
+    size -= 3;
+  }
+
+  // The first pass validates the schema and measures it, the second
+  // one fills a single block of memory
+  size_t num_conf = 0, pool_size = 0;
+  char *pool = NULL;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    unsigned int line_number = 0;
+    const char *end = buffer + size;
+    const char *line = buffer;
+    while (line < end)
+    {
+      const char *nl = (const char*)memchr(line, '\n', (size_t)(end - line));
+      size_t len = nl ? (size_t)(nl - line) : (size_t)(end - line);
+      line_number++;
+
+      _MicroConfSchemaLine entry;
+      unsigned int column = 0;
+      if (_micro_conf_schema_split(line, len, &entry, &column)
+          != MICRO_CONF_OK)
+        return _micro_conf_schema_fail(schema,
+                                       MICRO_CONF_ERROR_INVALID_SCHEMA,
+                                       line_number, column);
+      line += len + 1;
+      if (!entry.name) continue;
+
+      if (pass == 0)
       {
-        *((char**)conf[i].value) = strdup(value_str);
-        break;
+        num_conf++;
+        pool_size += entry.name_len + 1;
+        if (entry.default_str) pool_size += entry.default_len + 1;
+        continue;
       }
-      case MICRO_CONF_INT:
+
+      size_t i = schema->num_conf++;
+      MicroConf *conf = &schema->conf[i];
+      conf->type = entry.required
+        ? MICRO_CONF_REQUIRED_TYPE(entry.type) : entry.type;
+      conf->value = NULL;
+      conf->name = pool;
+      memcpy(pool, entry.name, entry.name_len);
+      pool[entry.name_len] = '\0';
+      pool += entry.name_len + 1;
+
+      schema->ranges[i] = entry.range;
+      schema->has_default[i] = entry.default_str != NULL;
+      if (entry.default_str)
       {
-        char *endptr;
-        long val = strtol(value_str, &endptr, 10);
-        if (*endptr != '\0')
+        memcpy(pool, entry.default_str, entry.default_len);
+        pool[entry.default_len] = '\0';
+        int err = _micro_conf_convert(entry.type, pool, entry.default_len,
+                                      &schema->defaults[i]);
+        if (err == MICRO_CONF_OK)
+          err = micro_conf_schema_validate(schema, i, &schema->defaults[i],
+                                           entry.default_len);
+        if (err != MICRO_CONF_OK)
         {
-          free(line);
-          fclose(file);
-          return MICRO_CONF_ERROR_INVALID_INT;
+          micro_conf_schema_destroy(schema);
+          _micro_conf_schema_fail(schema, MICRO_CONF_ERROR_INVALID_SCHEMA,
+                                  line_number, column);
+          schema->diag.entry = i;
+          return MICRO_CONF_ERROR_INVALID_SCHEMA;
         }
-        *((int*)conf[i].value) = (int)val;
-        break;
+        pool += entry.default_len + 1;
       }
-      case MICRO_CONF_DOUBLE:
+    }
+
+    if (pass == 1 || num_conf == 0) break;
+
+    size_t conf_size = _MICRO_CONF_ALIGN_UP(num_conf * sizeof(MicroConf));
+    size_t defaults_size = num_conf * sizeof(MicroConfValue);
+    size_t ranges_size = _MICRO_CONF_ALIGN_UP(num_conf * sizeof(MicroConfRange));
+    size_t memory_size = conf_size + defaults_size + ranges_size
+      + num_conf * sizeof(bool) + pool_size;
+    unsigned char *memory = (unsigned char*)
+      schema->allocator.alloc(schema->allocator.user, memory_size);
+    if (!memory)
+      return _micro_conf_schema_fail(schema, MICRO_CONF_ERROR_OUT_OF_MEMORY,
+                                     0, 0);
+
+    schema->memory = memory;
+    schema->memory_size = memory_size;
+    schema->conf = (MicroConf*)memory;
+    schema->defaults = (MicroConfValue*)(memory + conf_size);
+    schema->ranges = (MicroConfRange*)(memory + conf_size + defaults_size);
+    schema->has_default = (bool*)(memory + conf_size + defaults_size
+                                  + ranges_size);
+    pool = (char*)(memory + conf_size + defaults_size + ranges_size
+                   + num_conf * sizeof(bool));
+  }
+
+  // Without an index, lookups fall back to a linear scan
+  (void) micro_conf_index_build(&schema->index, schema->allocator,
+                                schema->conf, schema->num_conf);
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF int
+micro_conf_schema_validate(void *schema, size_t entry,
+                           const MicroConfValue *value, size_t len)
+{
+  const MicroConfSchema *s = (const MicroConfSchema*)schema;
+  const MicroConfRange *range = &s->ranges[entry];
+  if (range->flags == 0) return MICRO_CONF_OK;
+
+  double number;
+  switch (MICRO_CONF_TYPE(s->conf[entry].type))
+  {
+  case MICRO_CONF_INT:    number = value->i;      break;
+  case MICRO_CONF_FLOAT:  number = value->f;      break;
+  case MICRO_CONF_DOUBLE: number = value->d;      break;
+  case MICRO_CONF_STR:    number = (double)len;   break;
+  default:                return MICRO_CONF_OK;
+  }
+
+  if ((range->flags & MICRO_CONF_RANGE_MIN) && number < range->min)
+    return MICRO_CONF_ERROR_OUT_OF_RANGE;
+  if ((range->flags & MICRO_CONF_RANGE_MAX) && number > range->max)
+    return MICRO_CONF_ERROR_OUT_OF_RANGE;
+  return MICRO_CONF_OK;
+}
+
+MICRO_CONF_DEF void
+micro_conf_parser_use_schema(MicroConfParser *parser,
+                             MicroConfSchema *schema)
+{
+  if (!parser || !schema) return;
+  micro_conf_index_destroy(&parser->index);
+  parser->conf = schema->conf;
+  parser->num_conf = schema->num_conf;
+  parser->shared_index = &schema->index;
+  parser->prepared = NULL;
+  parser->validate = micro_conf_schema_validate;
+  parser->validate_user = schema;
+  parser->required_ready = false;
+}
+
+#ifndef MICRO_CONF_NO_MALLOC
+
+MICRO_CONF_DEF int
+micro_conf_schema_load(MicroConfSchema *schema, const char *pathname)
+{
+  if (!schema) return MICRO_CONF_ERROR_CONF_NULL;
+
+  FILE *file = fopen(pathname, "r");
+  if (!file)
+    return _micro_conf_schema_fail(schema, MICRO_CONF_ERROR_OPENING_FILE,
+                                   0, 0);
+
+  MicroConfAllocator *allocator = &schema->allocator;
+  char *buffer = NULL;
+  size_t size = 0, capacity = 0;
+  int err = MICRO_CONF_OK;
+  for (;;)
+  {
+    if (size == capacity)
+    {
+      size_t new_capacity = capacity ? capacity * 2 : MICRO_CONF_READ_SIZE;
+      char *new_buffer = (char*)allocator->realloc(allocator->user, buffer,
+                                                   capacity, new_capacity);
+      if (!new_buffer)
       {
-        char *endptr;
-        double val = strtod(value_str, &endptr);
-        if (*endptr != '\0')
-        {
-          free(line);
-          fclose(file);
-          return MICRO_CONF_ERROR_INVALID_DOUBLE;
-        }
-        *((double*)conf[i].value) = val;
+        err = MICRO_CONF_ERROR_OUT_OF_MEMORY;
         break;
       }
-      case MICRO_CONF_FLOAT:
+      buffer = new_buffer;
+      capacity = new_capacity;
+    }
+    size_t read = fread(buffer + size, 1, capacity - size, file);
+    size += read;
+    if (read == 0) break;
+  }
+
+  if (err == MICRO_CONF_OK && ferror(file))
+    err = MICRO_CONF_ERROR_READING_FILE;
+  if (fclose(file) != 0 && err == MICRO_CONF_OK)
+    err = MICRO_CONF_ERROR_CLOSING_FILE;
+  if (err == MICRO_CONF_OK)
+    err = micro_conf_schema_parse(schema, buffer, size);
+  else
+    _micro_conf_schema_fail(schema, err, 0, 0);
+
+  _micro_conf_release(allocator, buffer, capacity);
+  return err;
+}
+
+#endif // MICRO_CONF_NO_MALLOC
+
+#ifndef MICRO_CONF_NO_MALLOC
+
+//
+// Bulk loader
+//
+
+// A file being loaded by `micro_conf_load_many`
+typedef struct {
+  MicroConfParser parser;
+  char *chunk;
+  size_t job;
+  uint64_t offset;
+  int fd;
+} _MicroConfLoadSlot;
+
+static void _micro_conf_load_finish(MicroConfLoadJob *job,
+                                    MicroConfParser *parser, int error)
+{
+  if (error == MICRO_CONF_OK) error = micro_conf_parser_end(parser);
+  else if (parser->diag.error == MICRO_CONF_OK) parser->diag.error = error;
+  job->error = error;
+  job->diag = parser->diag;
+}
+
+// Load [jobs] one at a time with blocking reads
+static void _micro_conf_load_blocking(MicroConfLoadJob *jobs,
+                                      size_t num_jobs,
+                                      _MicroConfLoadSlot *slot)
+{
+  for (size_t i = 0; i < num_jobs; ++i)
+  {
+    MicroConfLoadJob *job = &jobs[i];
+#ifdef _MICRO_CONF_POSIX_IO
+    int err = micro_conf_parser_begin(&slot->parser, job->conf,
+                                      job->num_conf);
+    if (err != MICRO_CONF_OK)
+    {
+      _micro_conf_load_finish(job, &slot->parser, err);
+      continue;
+    }
+
+    int fd = open(job->pathname, O_RDONLY);
+    if (fd < 0)
+    {
+      _micro_conf_load_finish(job, &slot->parser,
+                              MICRO_CONF_ERROR_OPENING_FILE);
+      continue;
+    }
+
+    ssize_t n;
+    while ((n = read(fd, slot->chunk, MICRO_CONF_READ_SIZE)) > 0)
+    {
+      err = micro_conf_parser_feed(&slot->parser, slot->chunk, (size_t)n);
+      if (err != MICRO_CONF_OK) break;
+    }
+    if (err == MICRO_CONF_OK && n < 0) err = MICRO_CONF_ERROR_READING_FILE;
+    if (close(fd) != 0 && err == MICRO_CONF_OK)
+      err = MICRO_CONF_ERROR_CLOSING_FILE;
+    _micro_conf_load_finish(job, &slot->parser, err);
+#else
+    job->error = micro_conf_parser_parse(&slot->parser, job->conf,
+                                         job->num_conf, job->pathname);
+    job->diag = slot->parser.diag;
+#endif
+  }
+}
+
+#ifdef _MICRO_CONF_HAS_IO_URING
+
+typedef struct {
+  int fd;
+  unsigned char *sq_ring;
+  unsigned char *cq_ring;
+  size_t sq_ring_size;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned pending;  // Queued entries not yet made visible to the kernel
+} _MicroConfRing;
+
+static void _micro_conf_ring_close(_MicroConfRing *ring)
+{
+  if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);
+}
+
+// Whether the kernel of the ring [fd] supports the requests of the
+// loader. Kernels before 5.6 have io_uring, but not opens and closes.
+static bool _micro_conf_ring_supported(int fd)
+{
+  enum { MAX_OPS = 64 };
+  uint64_t buffer[(sizeof(struct io_uring_probe)
+                   + MAX_OPS * sizeof(struct io_uring_probe_op) + 7) / 8];
+  memset(buffer, 0, sizeof(buffer));
+  struct io_uring_probe *probe = (struct io_uring_probe*)buffer;
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+              MAX_OPS) < 0)
+    return false;
+
+  const unsigned ops[] = {IORING_OP_OPENAT, IORING_OP_READ,
+                          IORING_OP_CLOSE};
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i)
+    if (ops[i] > probe->last_op || ops[i] >= MAX_OPS ||
+        !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+      return false;
+  return true;
+}
+
+static bool _micro_conf_ring_open(_MicroConfRing *ring, unsigned entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(*ring));
+
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) return false;
+  if (!_micro_conf_ring_supported(ring->fd))
+  {
+    close(ring->fd);
+    return false;
+  }
+
+  ring->sq_ring_size = params.sq_off.array
+    + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = params.cq_off.cqes
+    + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap && ring->cq_ring_size > ring->sq_ring_size)
+    ring->sq_ring_size = ring->cq_ring_size;
+
+  void *ptr = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+  if (ptr == MAP_FAILED) goto fail;
+  ring->sq_ring = (unsigned char*)ptr;
+
+  if (single_mmap)
+  {
+    ring->cq_ring = ring->sq_ring;
+  }
+  else
+  {
+    ptr = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+    if (ptr == MAP_FAILED) goto fail;
+    ring->cq_ring = (unsigned char*)ptr;
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ptr = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED, ring->fd, IORING_OFF_SQES);
+  if (ptr == MAP_FAILED) goto fail;
+  ring->sqes = (struct io_uring_sqe*)ptr;
+
+  ring->sq_head  = (unsigned*)(ring->sq_ring + params.sq_off.head);
+  ring->sq_tail  = (unsigned*)(ring->sq_ring + params.sq_off.tail);
+  ring->sq_mask  = (unsigned*)(ring->sq_ring + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(ring->sq_ring + params.sq_off.array);
+  ring->cq_head  = (unsigned*)(ring->cq_ring + params.cq_off.head);
+  ring->cq_tail  = (unsigned*)(ring->cq_ring + params.cq_off.tail);
+  ring->cq_mask  = (unsigned*)(ring->cq_ring + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(ring->cq_ring + params.cq_off.cqes);
+  return true;
+
+ fail:
+  _micro_conf_ring_close(ring);
+  return false;
+}
+
+// Queue a submission for [slot]. The ring has one entry per slot and
+// each slot has at most one request in flight, so it never overflows.
+static struct io_uring_sqe* _micro_conf_ring_push(_MicroConfRing *ring,
+                                                  size_t slot)
+{
+  unsigned tail = *ring->sq_tail + ring->pending;
+  unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = slot;
+  ring->sq_array[index] = index;
+  ring->pending++;
+  return sqe;
+}
+
+// Submit the queued entries, and those the kernel did not take the
+// last time, and wait for at least one completion. Interrupted waits
+// are retried.
+static bool _micro_conf_ring_submit(_MicroConfRing *ring)
+{
+  unsigned tail = *ring->sq_tail + ring->pending;
+  __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+  ring->pending = 0;
+
+  for (;;)
+  {
+    unsigned to_submit = tail - __atomic_load_n(ring->sq_head,
+                                                __ATOMIC_ACQUIRE);
+    if (syscall(__NR_io_uring_enter, ring->fd, to_submit, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+      return true;
+    if (errno != EINTR) return false;
+  }
+}
+
+static void _micro_conf_ring_open_file(_MicroConfRing *ring,
+                                       _MicroConfLoadSlot *slot,
+                                       size_t s, const char *pathname)
+{
+  struct io_uring_sqe *sqe = _micro_conf_ring_push(ring, s);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uint64_t)(uintptr_t)pathname;
+  sqe->open_flags = O_RDONLY;
+  slot->fd = -1;
+  slot->offset = 0;
+}
+
+static void _micro_conf_ring_read(_MicroConfRing *ring,
+                                  _MicroConfLoadSlot *slot, size_t s)
+{
+  struct io_uring_sqe *sqe = _micro_conf_ring_push(ring, s);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = slot->fd;
+  sqe->addr = (uint64_t)(uintptr_t)slot->chunk;
+  sqe->len = MICRO_CONF_READ_SIZE;
+  sqe->off = slot->offset;
+}
+
+static void _micro_conf_ring_close_file(_MicroConfRing *ring,
+                                        _MicroConfLoadSlot *slot, size_t s)
+{
+  struct io_uring_sqe *sqe = _micro_conf_ring_push(ring, s);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = slot->fd;
+  // Mark the slot as closing
+  slot->offset = UINT64_MAX;
+}
+
+// Start the next job in slot [s], returns false if there is none.
+// Jobs whose parse cannot begin are finished immediately.
+static bool _micro_conf_ring_next(_MicroConfRing *ring,
+                                  _MicroConfLoadSlot *slots, size_t s,
+                                  MicroConfLoadJob *jobs, size_t num_jobs,
+                                  size_t *next_job)
+{
+  _MicroConfLoadSlot *slot = &slots[s];
+  slot->job = _MICRO_CONF_NOT_FOUND;
+  while (*next_job < num_jobs)
+  {
+    size_t j = (*next_job)++;
+    int err = micro_conf_parser_begin(&slot->parser, jobs[j].conf,
+                                      jobs[j].num_conf);
+    if (err != MICRO_CONF_OK)
+    {
+      _micro_conf_load_finish(&jobs[j], &slot->parser, err);
+      continue;
+    }
+    slot->job = j;
+    _micro_conf_ring_open_file(ring, slot, s, jobs[j].pathname);
+    return true;
+  }
+  return false;
+}
+
+// Handle the completion of the request of slot [s] with result [res].
+// Returns false if the slot has no more work.
+static bool _micro_conf_ring_complete(_MicroConfRing *ring,
+                                      _MicroConfLoadSlot *slots, size_t s,
+                                      int res, MicroConfLoadJob *jobs,
+                                      size_t num_jobs, size_t *next_job)
+{
+  _MicroConfLoadSlot *slot = &slots[s];
+  MicroConfLoadJob *job = &jobs[slot->job];
+
+  if (slot->fd < 0)
+  {
+    // Open completed
+    if (res >= 0)
+    {
+      slot->fd = res;
+      _micro_conf_ring_read(ring, slot, s);
+      return true;
+    }
+    _micro_conf_load_finish(job, &slot->parser,
+                            MICRO_CONF_ERROR_OPENING_FILE);
+  }
+  else if (slot->offset != UINT64_MAX)
+  {
+    // Read completed, the file is closed at the end or on error
+    int err = MICRO_CONF_OK;
+    if (res < 0) err = MICRO_CONF_ERROR_READING_FILE;
+    else if (res > 0)
+      err = micro_conf_parser_feed(&slot->parser, slot->chunk, (size_t)res);
+
+    if (err == MICRO_CONF_OK && res > 0)
+    {
+      slot->offset += (uint64_t)res;
+      _micro_conf_ring_read(ring, slot, s);
+      return true;
+    }
+    if (err != MICRO_CONF_OK && slot->parser.diag.error == MICRO_CONF_OK)
+      slot->parser.diag.error = err;
+    _micro_conf_ring_close_file(ring, slot, s);
+    return true;
+  }
+  else
+  {
+    // Close completed
+    int err = slot->parser.diag.error;
+    if (err == MICRO_CONF_OK && res < 0) err = MICRO_CONF_ERROR_CLOSING_FILE;
+    _micro_conf_load_finish(job, &slot->parser, err);
+  }
+
+  return _micro_conf_ring_next(ring, slots, s, jobs, num_jobs, next_job);
+}
+
+// Fail the job of slot [s] of a ring that stopped working, once its
+// request completed with [res], or if the kernel never [started] it
+static void _micro_conf_ring_drop(_MicroConfLoadSlot *slots, size_t s,
+                                  MicroConfLoadJob *jobs, bool started,
+                                  int res)
+{
+  _MicroConfLoadSlot *slot = &slots[s];
+  if (slot->job == _MICRO_CONF_NOT_FOUND) return;
+  if (slot->fd < 0)
+  {
+    if (started && res >= 0) close(res);
+  }
+  else if (slot->offset != UINT64_MAX || !started)
+  {
+    close(slot->fd);
+  }
+  _micro_conf_load_finish(&jobs[slot->job], &slot->parser,
+                          MICRO_CONF_ERROR_READING_FILE);
+  slot->job = _MICRO_CONF_NOT_FOUND;
+}
+
+// Fail the jobs of all the slots after a submission failed. The
+// requests taken by the kernel are waited for, so that no read
+// writes to a chunk after it is freed and no opened file leaks.
+// Returns false if they could not be waited for.
+static bool _micro_conf_ring_abandon(_MicroConfRing *ring,
+                                     _MicroConfLoadSlot *slots,
+                                     size_t num_slots,
+                                     MicroConfLoadJob *jobs)
+{
+  // Requests left in the submission queue never started
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  for (; head != *ring->sq_tail; ++head)
+  {
+    unsigned index = ring->sq_array[head & *ring->sq_mask];
+    _micro_conf_ring_drop(slots, (size_t)ring->sqes[index].user_data,
+                          jobs, false, 0);
+  }
+
+  size_t waiting = 0;
+  for (size_t s = 0; s < num_slots; ++s)
+    if (slots[s].job != _MICRO_CONF_NOT_FOUND) waiting++;
+
+  while (waiting > 0)
+  {
+    head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      _micro_conf_ring_drop(slots, (size_t)cqe->user_data, jobs, true,
+                            cqe->res);
+      waiting--;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    if (waiting == 0) break;
+
+    long ret;
+    do
+      ret = syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+    while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+    {
+      // The requests may still be running, only fail their jobs
+      for (size_t s = 0; s < num_slots; ++s)
+        if (slots[s].job != _MICRO_CONF_NOT_FOUND)
+          _micro_conf_load_finish(&jobs[slots[s].job], &slots[s].parser,
+                                  MICRO_CONF_ERROR_READING_FILE);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Load [jobs] with io_uring, returns false if io_uring is not
+// available and nothing was loaded. [drained] is set to false if
+// requests may still write to the chunks of [slots].
+static bool _micro_conf_load_io_uring(MicroConfLoadJob *jobs,
+                                      size_t num_jobs,
+                                      _MicroConfLoadSlot *slots,
+                                      size_t num_slots, bool *drained)
+{
+  _MicroConfRing ring;
+  if (!_micro_conf_ring_open(&ring, (unsigned)num_slots)) return false;
+
+  size_t next_job = 0;
+  size_t in_flight = 0;
+  for (size_t s = 0; s < num_slots; ++s)
+    if (_micro_conf_ring_next(&ring, slots, s, jobs, num_jobs, &next_job))
+      in_flight++;
+
+  while (in_flight > 0)
+  {
+    if (!_micro_conf_ring_submit(&ring))
+    {
+      // The ring is unusable, abandon the files in flight
+      *drained = _micro_conf_ring_abandon(&ring, slots, num_slots, jobs);
+      for (; next_job < num_jobs; ++next_job)
       {
-        char *endptr;
-        double val = strtof(value_str, &endptr);
-        if (*endptr != '\0')
-        {
-          free(line);
-          fclose(file);
-          return MICRO_CONF_ERROR_INVALID_FLOAT;
-        }
-        *((float*)conf[i].value) = val;
-        break;
-      }
-      default:
-        free(line);
-        fclose(file);
-        return MICRO_CONF_ERROR_UNKNOWN_TYPE;
+        jobs[next_job].error = MICRO_CONF_ERROR_READING_FILE;
+        jobs[next_job].diag.error = MICRO_CONF_ERROR_READING_FILE;
       }
-
       break;
     }
+
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+      if (!_micro_conf_ring_complete(&ring, slots, (size_t)cqe->user_data,
+                                     cqe->res, jobs, num_jobs, &next_job))
+        in_flight--;
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  _micro_conf_ring_close(&ring);
+  return true;
+}
+
+#endif // _MICRO_CONF_HAS_IO_URING
+
+MICRO_CONF_DEF int
+micro_conf_load_many(MicroConfLoadJob *jobs, size_t num_jobs,
+                     MicroConfAllocator allocator)
+{
+  if (!jobs) return MICRO_CONF_ERROR_CONF_NULL;
+  if (num_jobs == 0) return MICRO_CONF_OK;
+
+  for (size_t i = 0; i < num_jobs; ++i)
+  {
+    jobs[i].error = MICRO_CONF_OK;
+    memset(&jobs[i].diag, 0, sizeof(jobs[i].diag));
+    jobs[i].diag.entry = _MICRO_CONF_NOT_FOUND;
+  }
+
+  size_t num_slots = 1;
+#ifdef _MICRO_CONF_HAS_IO_URING
+  num_slots = num_jobs < MICRO_CONF_LOAD_DEPTH
+    ? num_jobs : MICRO_CONF_LOAD_DEPTH;
+#endif
+
+  size_t slots_size = num_slots * sizeof(_MicroConfLoadSlot);
+  size_t chunks_size = num_slots * MICRO_CONF_READ_SIZE;
+  _MicroConfLoadSlot *slots = (_MicroConfLoadSlot*)
+    allocator.alloc(allocator.user, slots_size);
+  char *chunks = slots
+    ? (char*)allocator.alloc(allocator.user, chunks_size) : NULL;
+  if (!chunks)
+  {
+    _micro_conf_release(&allocator, slots, slots_size);
+    return MICRO_CONF_ERROR_OUT_OF_MEMORY;
   }
 
-  free(line);
-  if (fclose(file) != 0) return MICRO_CONF_ERROR_CLOSING_FILE;
+  for (size_t s = 0; s < num_slots; ++s)
+  {
+    micro_conf_parser_init_allocator(&slots[s].parser, allocator);
+    slots[s].chunk = chunks + s * MICRO_CONF_READ_SIZE;
+    slots[s].job = _MICRO_CONF_NOT_FOUND;
+    slots[s].offset = 0;
+    slots[s].fd = -1;
+  }
+
+  bool loaded = false;
+  bool drained = true;
+#ifdef _MICRO_CONF_HAS_IO_URING
+  loaded = _micro_conf_load_io_uring(jobs, num_jobs, slots, num_slots,
+                                     &drained);
+#endif
+  if (!loaded) _micro_conf_load_blocking(jobs, num_jobs, &slots[0]);
+
+  // Release in reverse order, so that arenas can reclaim the memory
+  for (size_t s = num_slots; s > 0; --s)
+    micro_conf_parser_destroy(&slots[s - 1].parser);
+  // Reads that could not be waited for may still write to the chunks,
+  // which are leaked instead
+  if (drained) _micro_conf_release(&allocator, chunks, chunks_size);
+  _micro_conf_release(&allocator, slots, slots_size);
+
+  for (size_t i = 0; i < num_jobs; ++i)
+    if (jobs[i].error != MICRO_CONF_OK) return jobs[i].error;
   return MICRO_CONF_OK;
 }
+
+#endif // MICRO_CONF_NO_MALLOC
   
 #endif // MICRO_CONF_IMPLEMENTATION
 
@@ -380,17 +5745,6 @@ typedef struct {
 int main(void)
 {
   MyConf conf;
-  // Defaults
-  conf.an_integer = 10;
-  conf.a_float = 11.0f;
-  conf.a_double = 123.123;
-  conf.a_bool = true;
-  conf.a_char = 'F';
-  conf.a_str = "test";
-  conf.vec = (Vec2) {
-    .x = 1,
-    .y = 1,
-  };
   
   MicroConf config[] =
     {
@@ -404,8 +5758,27 @@ int main(void)
       {MICRO_CONF_INT, &conf.vec.y, "vec.y"},
     };
   size_t num_conf = sizeof(config) / sizeof(config[0]);
+
+  // Defaults, one for each entry of config
+  MicroConfValue defaults[] =
+    {
+      {.i = 10},
+      {.f = 11.0f},
+      {.d = 123.123},
+      {.b = true},
+      {.c = 'F'},
+      {.s = "test"},
+      {.i = 1},
+      {.i = 1},
+    };
+  MicroConfDefaults plan;
+  int err = micro_conf_defaults_build(&plan, micro_conf_allocator_default(),
+                                      config, defaults, NULL, num_conf);
+  if (err != MICRO_CONF_OK) return -err;
+  micro_conf_apply_defaults(&plan);
+  micro_conf_defaults_destroy(&plan);
   
-  int err = micro_conf_parse(config, num_conf, "micro.conf");
+  err = micro_conf_parse(config, num_conf, "micro.conf");
   if (err != MICRO_CONF_OK) return -err;
 
   // ...